@@ -0,0 +1,123 @@
+// Rasterization throughput of SoftwareOcclusion, without any GL: a field of
+// random boxes in front of the camera is rasterized repeatedly and then
+// used to test other boxes.
+//
+//   software_occlusion_benchmark [boxes] [frames] [workers]
+//
+// Configure with -DOCCLUSION_AVX2=ON to measure the 8-wide AVX2 path.
+
+#include <learnopengl/software_occlusion.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace {
+
+struct Vertex {
+    glm::vec3 Position;
+};
+
+// unit cube around the origin, counter-clockwise faces seen from outside
+void cube(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices) {
+    for (int corner = 0; corner < 8; corner++) {
+        vertices.push_back(Vertex { glm::vec3(
+            corner & 1 ? 0.5f : -0.5f, corner & 2 ? 0.5f : -0.5f,
+            corner & 4 ? 0.5f : -0.5f) });
+    }
+    indices = { 0, 2, 3, 0, 3, 1, 4, 5, 7, 4, 7, 6, 0, 1, 5, 0, 5, 4,
+                2, 6, 7, 2, 7, 3, 0, 4, 6, 0, 6, 2, 1, 3, 7, 1, 7, 5 };
+}
+
+double milliseconds(
+    const std::chrono::steady_clock::time_point start,
+    const std::chrono::steady_clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    const int boxes = argc > 1 ? std::atoi(argv[1]) : 2000;
+    const int frames = argc > 2 ? std::atoi(argv[2]) : 200;
+    const unsigned workers =
+        argc > 3 ? static_cast<unsigned>(std::atoi(argv[3]))
+                 : SoftwareOcclusion::defaultWorkers();
+
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    cube(vertices, indices);
+
+    std::mt19937 random { 1u };
+    std::uniform_real_distribution<float> lateral { -40.0f, 40.0f };
+    std::uniform_real_distribution<float> depth { -120.0f, -5.0f };
+    std::uniform_real_distribution<float> size { 0.5f, 8.0f };
+    const auto randomBox = [&]() {
+        glm::mat4 model = glm::translate(
+            glm::mat4(1.0f),
+            glm::vec3(lateral(random), 0.5f * lateral(random), depth(random)));
+        return glm::scale(
+            model, glm::vec3(size(random), size(random), size(random)));
+    };
+    std::vector<glm::mat4> occluders;
+    for (int i = 0; i < boxes; i++)
+        occluders.push_back(randomBox());
+
+    const glm::mat4 viewProjection =
+        glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 200.0f) *
+        glm::lookAt(
+            glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f),
+            glm::vec3(0.0f, 1.0f, 0.0f));
+
+    SoftwareOcclusion occlusion { 256, 192, workers };
+    const unsigned cubeMesh = occlusion.addMesh(vertices, indices);
+    double queueTime = 0.0;
+    double rasterTime = 0.0;
+    std::size_t triangles = 0;
+    for (int frame = 0; frame < frames; frame++) {
+        const auto start = std::chrono::steady_clock::now();
+        occlusion.begin(viewProjection);
+        for (const glm::mat4 &model : occluders)
+            occlusion.addOccluder(cubeMesh, model);
+        const auto queued = std::chrono::steady_clock::now();
+        occlusion.rasterize();
+        const auto end = std::chrono::steady_clock::now();
+        queueTime += milliseconds(start, queued);
+        rasterTime += milliseconds(queued, end);
+        triangles += occlusion.triangles();
+    }
+
+    const int tests = 100000;
+    int occluded = 0;
+    std::vector<AABB> queries;
+    for (int i = 0; i < tests; i++) {
+        AABB box;
+        box.add(glm::vec3(-0.5f));
+        box.add(glm::vec3(0.5f));
+        queries.push_back(box.transformed(randomBox()));
+    }
+    const auto testStart = std::chrono::steady_clock::now();
+    for (const AABB &box : queries)
+        occluded += occlusion.occlusion().occluded(box);
+    const double testTime =
+        milliseconds(testStart, std::chrono::steady_clock::now());
+
+    std::cout << "SIMD width " << simd::WIDTH << ", " << workers
+              << " worker threads, " << occlusion.width() << "x"
+              << occlusion.height() << " depth" << std::endl;
+    std::cout << boxes << " boxes, " << triangles / frames
+              << " front-facing triangles per frame" << std::endl;
+    std::cout << "queueing: " << queueTime / frames << " ms/frame"
+              << std::endl;
+    std::cout << "setup and rasterization: " << rasterTime / frames
+              << " ms/frame, " << triangles / rasterTime << " triangles/ms"
+              << std::endl;
+    std::cout << "box tests: " << tests / testTime << " boxes/ms, "
+              << 100.0 * occluded / tests << "% occluded" << std::endl;
+    return 0;
+}
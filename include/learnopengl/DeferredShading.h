@@ -3,22 +3,57 @@
 
 #include <glad/glad.h>
 
+#include <learnopengl/clustered_shading.h>
+#include <learnopengl/depth_pyramid.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/gpu_query.h>
+#include <learnopengl/light_manager.h>
+#include <learnopengl/light_volumes.h>
 #include <learnopengl/shader.h>
+#include <learnopengl/shader_variants.h>
 
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <vector>
 
 class DeferredShading {
 
   public:
+    // features both lighting passes are built with, in key bit order
+    enum LightingFeature : unsigned { FLASHLIGHT = 1u << 0 };
+    static std::vector<std::string> lightingFeatures() {
+        return { "FLASHLIGHT" };
+    }
+
     DeferredShading(
-        const unsigned width, const unsigned height, Shader &geometryPass,
-        Shader &lightingPass)
-        : m_geometryPass { geometryPass }
-        , m_lightingPass { lightingPass } {
+        const unsigned width, const unsigned height,
+        ShaderVariants &lightingPass)
+        : m_lightingPass { lightingPass }
+        , m_lightingMotion { lightingPass.handle<bool>("gpuLightMotion") } {
         resize(width, height);
         m_lightingPass.uniform("gPosition", 0);
         m_lightingPass.uniform("gNormal", 1);
         m_lightingPass.uniform("gAlbedoSpec", 2);
+        m_lightingPass.uniform("gDepth", 5);
+        m_lightingPass.uniform("compactGBuffer", m_compactGBuffer);
+        m_lightingPass.uniform("lightTiles", 3);
+        m_lightingPass.uniform("lightIndices", 4);
+        m_lightingPass.uniform("tileSize", static_cast<int>(TILE_SIZE));
+        m_lightingPass.uniform("tiledLighting", m_tiledLighting);
+        m_lightingPass.uniform("lightVolumes", false);
+
+        // per-tile light index list, read through a buffer texture
+        glGenBuffers(1, &m_lightIndexBuffer);
+        glGenTextures(1, &m_lightIndices);
+        glBindBuffer(GL_TEXTURE_BUFFER, m_lightIndexBuffer);
+        glBufferData(
+            GL_TEXTURE_BUFFER, sizeof(GLuint), nullptr, GL_STREAM_DRAW);
+        GLState::get().bindTexture(4, GL_TEXTURE_BUFFER, m_lightIndices);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, m_lightIndexBuffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
 
         float quadVertices[] = {
             -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, -1.0f, -1.0f, 0.0f, 0.0f, 0.0f,
@@ -27,7 +62,7 @@ class DeferredShading {
         // setup plane VAO
         glGenVertexArrays(1, &m_quadVAO);
         glGenBuffers(1, &m_quadVBO);
-        glBindVertexArray(m_quadVAO);
+        GLState::get().bindVertexArray(m_quadVAO);
         glBindBuffer(GL_ARRAY_BUFFER, m_quadVBO);
         glBufferData(
             GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices,
@@ -42,111 +77,506 @@ class DeferredShading {
     }
 
     void resize(const unsigned width, const unsigned height) {
-        glDeleteFramebuffers(1, &m_gBuffer);
-        glDeleteTextures(1, &m_gPosition);
-        glDeleteTextures(1, &m_gNormal);
-        glDeleteTextures(1, &m_gAlbedoSpec);
-        glDeleteRenderbuffers(1, &m_rboDepth);
+        GLState::get().deleteFramebuffers(1, &m_gBuffer);
+        GLState::get().deleteTextures(1, &m_gPosition);
+        GLState::get().deleteTextures(1, &m_gNormal);
+        GLState::get().deleteTextures(1, &m_gAlbedoSpec);
+        GLState::get().deleteTextures(1, &m_gDepth);
+        GLState::get().deleteTextures(1, &m_lightTiles);
+        m_gPosition = 0;
         // configure g-buffer framebuffer
         // ------------------------------
         glGenFramebuffers(1, &m_gBuffer);
-        glBindFramebuffer(GL_FRAMEBUFFER, m_gBuffer);
-        // position color buffer
-        glGenTextures(1, &m_gPosition);
-        glBindTexture(GL_TEXTURE_2D, m_gPosition);
-        glTexImage2D(
-            GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT,
-            nullptr);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glFramebufferTexture2D(
-            GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_gPosition,
-            0);
-        // normal color buffer
-        glGenTextures(1, &m_gNormal);
-        glBindTexture(GL_TEXTURE_2D, m_gNormal);
-        glTexImage2D(
-            GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT,
-            nullptr);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glFramebufferTexture2D(
-            GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, m_gNormal, 0);
-        // color + specular color buffer
-        glGenTextures(1, &m_gAlbedoSpec);
-        glBindTexture(GL_TEXTURE_2D, m_gAlbedoSpec);
-        glTexImage2D(
-            GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA,
-            GL_UNSIGNED_BYTE, nullptr);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glFramebufferTexture2D(
-            GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, m_gAlbedoSpec,
-            0);
-        // tell OpenGL which color attachments we'll use (of this framebuffer)
-        // for rendering
-        unsigned int attachments[3] = { GL_COLOR_ATTACHMENT0,
-                                        GL_COLOR_ATTACHMENT1,
-                                        GL_COLOR_ATTACHMENT2 };
-        glDrawBuffers(3, attachments);
-        // create and attach depth buffer (renderbuffer)
-        glGenRenderbuffers(1, &m_rboDepth);
-        glBindRenderbuffer(GL_RENDERBUFFER, m_rboDepth);
-        glRenderbufferStorage(
-            GL_RENDERBUFFER, GL_DEPTH_COMPONENT, width, height);
-        glFramebufferRenderbuffer(
-            GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_rboDepth);
+        GLState::get().bindFramebuffer(GL_FRAMEBUFFER, m_gBuffer);
+        if (m_compactGBuffer) {
+            // octahedral normal in RG16, albedo + specular in RGBA8; the
+            // position is reconstructed from depth in the lighting pass
+            m_gNormal = attachTexture(
+                GL_COLOR_ATTACHMENT0, GL_RG16, width, height, GL_RG,
+                GL_UNSIGNED_SHORT);
+            m_gAlbedoSpec = attachTexture(
+                GL_COLOR_ATTACHMENT1, GL_RGBA8, width, height, GL_RGBA,
+                GL_UNSIGNED_BYTE);
+            // g_buffer.frag writes position, normal, albedo to outputs 0-2
+            unsigned int attachments[3] = { GL_NONE, GL_COLOR_ATTACHMENT0,
+                                            GL_COLOR_ATTACHMENT1 };
+            glDrawBuffers(3, attachments);
+        } else {
+            // position color buffer
+            m_gPosition = attachTexture(
+                GL_COLOR_ATTACHMENT0, GL_RGBA16F, width, height, GL_RGBA,
+                GL_FLOAT);
+            // normal color buffer
+            m_gNormal = attachTexture(
+                GL_COLOR_ATTACHMENT1, GL_RGBA16F, width, height, GL_RGBA,
+                GL_FLOAT);
+            // color + specular color buffer
+            m_gAlbedoSpec = attachTexture(
+                GL_COLOR_ATTACHMENT2, GL_RGBA16F, width, height, GL_RGBA,
+                GL_UNSIGNED_BYTE);
+            // tell OpenGL which color attachments we'll use (of this
+            // framebuffer) for rendering
+            unsigned int attachments[3] = { GL_COLOR_ATTACHMENT0,
+                                            GL_COLOR_ATTACHMENT1,
+                                            GL_COLOR_ATTACHMENT2 };
+            glDrawBuffers(3, attachments);
+        }
+        // sampleable depth buffer; same format as the HDR depth buffer it is
+        // blitted to. The stencil marks the pixels the geometry pass
+        // covered for light volume lighting.
+        m_gDepth = attachTexture(
+            GL_DEPTH_STENCIL_ATTACHMENT, GL_DEPTH24_STENCIL8, width, height,
+            GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8);
         // finally check if framebuffer is complete
         if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
             std::cout << "Framebuffer not complete!" << std::endl;
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        GLState::get().bindFramebuffer(GL_FRAMEBUFFER, 0);
 
         m_width = width;
         m_height = height;
+
+        // (offset, count) into the light index list for every screen tile
+        m_tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+        m_tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+        glGenTextures(1, &m_lightTiles);
+        GLState::get().bindTexture(3, GL_TEXTURE_2D, m_lightTiles);
+        glTexImage2D(
+            GL_TEXTURE_2D, 0, GL_RG32UI, m_tilesX, m_tilesY, 0, GL_RG_INTEGER,
+            GL_UNSIGNED_INT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        m_tileRanges.assign(2 * m_tilesX * m_tilesY, 0u);
+
+        if (m_depthPyramid) m_depthPyramid->resize(width, height);
+    }
+
+    // uploads the lights for the active lighting mode and builds its light
+    // lists: per cluster on the GPU for clustered lighting, per screen tile
+    // on the CPU for tiled lighting, the lights on screen for light volumes
+    void updateLights(
+        LightManager &lights, const glm::mat4 &view,
+        const glm::mat4 &projection) {
+        if (clusteredLighting()) {
+            m_clusteredMotion.set(lights.gpuMotion());
+            lights.uploadStorage();
+            m_clustered->update(lights, projection, m_width, m_height);
+            return;
+        }
+        m_lightingMotion.set(lights.gpuMotion());
+        lights.uploadUniformBlock();
+        if (drawsLightVolumes()) {
+            selectLightVolumes(lights, view, projection);
+            return;
+        }
+        if (!m_tiledLighting) return;
+
+        const unsigned tileCount = m_tilesX * m_tilesY;
+        // first pass: tile rectangle of each light and the count per tile
+        m_lightRects.clear();
+        std::fill(m_tileRanges.begin(), m_tileRanges.end(), 0u);
+        for (const auto &light : lights.lights()) {
+            // tiles index into the MagicLights uniform block
+            if (light.index() >= LightManager::UNIFORM_LIGHTS) continue;
+            glm::vec3 center;
+            float radius;
+            lights.influence(light, center, radius);
+            TileRect rect {};
+            if (!tileRect(center, radius, view, projection, rect)) continue;
+            rect.index = light.index();
+            m_lightRects.push_back(rect);
+            for (unsigned y = rect.y0; y <= rect.y1; y++) {
+                for (unsigned x = rect.x0; x <= rect.x1; x++) {
+                    m_tileRanges[2 * (y * m_tilesX + x) + 1]++;
+                }
+            }
+        }
+        // offsets are the exclusive prefix sum of the counts
+        unsigned offset = 0;
+        for (unsigned tile = 0; tile < tileCount; tile++) {
+            m_tileRanges[2 * tile] = offset;
+            offset += m_tileRanges[2 * tile + 1];
+        }
+        // second pass: scatter light indices into their tiles' ranges
+        m_lightIndexList.resize(std::max(offset, 1u));
+        std::vector<unsigned> cursor(tileCount);
+        for (unsigned tile = 0; tile < tileCount; tile++) {
+            cursor[tile] = m_tileRanges[2 * tile];
+        }
+        for (const auto &rect : m_lightRects) {
+            for (unsigned y = rect.y0; y <= rect.y1; y++) {
+                for (unsigned x = rect.x0; x <= rect.x1; x++) {
+                    m_lightIndexList[cursor[y * m_tilesX + x]++] = rect.index;
+                }
+            }
+        }
+
+        GLState::get().bindTexture(3, GL_TEXTURE_2D, m_lightTiles);
+        glTexSubImage2D(
+            GL_TEXTURE_2D, 0, 0, 0, m_tilesX, m_tilesY, GL_RG_INTEGER,
+            GL_UNSIGNED_INT, m_tileRanges.data());
+        glBindBuffer(GL_TEXTURE_BUFFER, m_lightIndexBuffer);
+        glBufferData(
+            GL_TEXTURE_BUFFER, m_lightIndexList.size() * sizeof(GLuint),
+            m_lightIndexList.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    bool tiledLighting() const { return m_tiledLighting; }
+
+    void setTiledLighting(const bool tiled) {
+        m_tiledLighting = tiled;
+        m_lightingPass.uniform("tiledLighting", m_tiledLighting);
+    }
+
+    bool compactGBuffer() const { return m_compactGBuffer; }
+
+    // switches between the classic and the compact G-buffer layout,
+    // reallocating the attachments
+    void setCompactGBuffer(const bool compact) {
+        if (compact == m_compactGBuffer) return;
+        m_compactGBuffer = compact;
+        resize(m_width, m_height);
+        setLightingUniform("compactGBuffer", m_compactGBuffer);
+    }
+
+    // bytes written per pixel by the geometry pass, depth included
+    unsigned gBufferBytesPerPixel() const {
+        return m_compactGBuffer ? 4 + 4 + 4 : 8 + 8 + 8 + 4;
+    }
+
+    // clustered lighting is optional (GL 4.3); once set, it can be toggled
+    // and takes precedence over tiled lighting
+    void setClusteredShading(ClusteredShading *clustered) {
+        m_clustered = clustered;
+        if (!m_clustered) return;
+        ShaderVariants &shader = m_clustered->lightingPasses();
+        m_clusteredMotion = shader.handle<bool>("gpuLightMotion");
+        shader.uniform("gPosition", 0);
+        shader.uniform("gNormal", 1);
+        shader.uniform("gAlbedoSpec", 2);
+        shader.uniform("gDepth", 5);
+        shader.uniform("compactGBuffer", m_compactGBuffer);
+    }
+
+    bool clusteredLighting() const {
+        return m_clustered && m_clusteredLighting;
+    }
+
+    const ClusteredShading *clusteredShading() const { return m_clustered; }
+
+    void setClusteredLighting(const bool clustered) {
+        m_clusteredLighting = clustered;
+    }
+
+    // light volumes are optional; once set, they can be toggled. They take
+    // precedence over tiled lighting, clustered lighting over them.
+    void setLightVolumes(LightVolumes *volumes) {
+        m_lightVolumes = volumes;
+        if (!m_lightVolumes) return;
+        Shader &shader = m_lightVolumes->lightingPass();
+        shader.uniform("gPosition", 0);
+        shader.uniform("gNormal", 1);
+        shader.uniform("gAlbedoSpec", 2);
+        shader.uniform("gDepth", 5);
+        shader.uniform("compactGBuffer", m_compactGBuffer);
+    }
+
+    // also limits the full-screen pass to the pixels the geometry pass
+    // covered, with clustered lighting too
+    bool lightVolumeLighting() const {
+        return m_lightVolumes && m_lightVolumeLighting;
+    }
+
+    void setLightVolumeLighting(const bool enabled) {
+        m_lightVolumeLighting = enabled;
+        m_lightingPass.uniform("lightVolumes", lightVolumeLighting());
+    }
+
+    bool flashlight() const { return m_lightingVariant & FLASHLIGHT; }
+
+    // selects the lighting pass variant with or without the flashlight
+    void setFlashlight(const bool flashlight) {
+        m_lightingVariant = flashlight ? m_lightingVariant | FLASHLIGHT
+                                       : m_lightingVariant & ~FLASHLIGHT;
     }
 
     void render(GLuint fbo) {
-        glBindVertexArray(m_quadVAO);
+        if (lightVolumeLighting()) {
+            renderMasked(fbo);
+            return;
+        }
+        // updateLights() may have switched to the compute program
+        lightingPassShader().use();
+        GLState::get().bindVertexArray(m_quadVAO);
         glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-        glBindVertexArray(0);
 
-        glBindFramebuffer(GL_READ_FRAMEBUFFER, m_gBuffer);
-        glBindFramebuffer(
+        GLState::get().bindFramebuffer(GL_READ_FRAMEBUFFER, m_gBuffer);
+        GLState::get().bindFramebuffer(
             GL_DRAW_FRAMEBUFFER, fbo); // write to default framebuffer
         glBlitFramebuffer(
             0, 0, m_width, m_height, 0, 0, m_width, m_height,
             GL_DEPTH_BUFFER_BIT, GL_NEAREST);
-        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        GLState::get().bindFramebuffer(GL_FRAMEBUFFER, fbo);
     }
 
+    // with light volume lighting the geometry pass sets the stencil of
+    // every pixel it covers to 1
     void bindGBuffer() const {
-        glBindFramebuffer(GL_FRAMEBUFFER, m_gBuffer);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        GLState::get().bindFramebuffer(GL_FRAMEBUFFER, m_gBuffer);
+        glClear(
+            GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+        if (lightVolumeLighting()) {
+            glEnable(GL_STENCIL_TEST);
+            glStencilFunc(GL_ALWAYS, 1, 0xFF);
+            glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+        }
+    }
+
+    // with the depth pre-pass the scene is first drawn into the depth
+    // buffer only, so the geometry pass shades every pixel once
+    bool depthPrePass() const { return m_depthPrePass; }
+
+    void setDepthPrePass(const bool enabled) { m_depthPrePass = enabled; }
+
+    // after bindGBuffer() if depthPrePass(); color writes stay off until
+    // beginGeometryPass()
+    void beginDepthPrePass() {
+        m_depthPrePassTime.begin();
+        m_inDepthPrePass = true;
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    }
+
+    // after a depth pre-pass the depth buffer is final: fragments are
+    // tested for equality with it and depth is not written again
+    void beginGeometryPass() {
+        m_timedPrePass = m_inDepthPrePass;
+        if (m_inDepthPrePass) {
+            m_depthPrePassTime.end();
+            m_inDepthPrePass = false;
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            glDepthFunc(GL_EQUAL);
+            glDepthMask(GL_FALSE);
+        }
+        m_geometryPassTime[m_timedPrePass].begin();
+    }
+
+    void endGeometryPass() {
+        m_geometryPassTime[m_timedPrePass].end();
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+        glDisable(GL_STENCIL_TEST);
+    }
+
+    // pyramid built from the G-buffer depth by buildDepthPyramid() for
+    // occlusion culling; it follows resize()
+    void setDepthPyramid(DepthPyramid *pyramid) {
+        m_depthPyramid = pyramid;
+        if (m_depthPyramid) m_depthPyramid->resize(m_width, m_height);
+    }
+
+    bool occlusionCulling() const { return m_occlusionCulling; }
+
+    // the pyramid is not built while culling is off, so it is dropped when
+    // culling is turned back on rather than tested against stale depth
+    void setOcclusionCulling(const bool enabled) {
+        if (enabled && !m_occlusionCulling && m_depthPyramid)
+            m_depthPyramid->invalidate();
+        m_occlusionCulling = enabled;
+    }
+
+    // after endGeometryPass(): reduces this frame's depth, rendered with
+    // `viewProjection`, into the pyramid for the next frames' culling
+    void buildDepthPyramid(const glm::mat4 &viewProjection) {
+        if (!m_occlusionCulling || !m_depthPyramid) return;
+        m_depthPyramid->build(m_gDepth, viewProjection, m_quadVAO);
+        glViewport(0, 0, m_width, m_height);
+    }
+
+    // the pyramid to cull against, or null with occlusion culling off or
+    // before its first build
+    const DepthPyramid *depthPyramid() const {
+        return m_occlusionCulling && m_depthPyramid && m_depthPyramid->built()
+                   ? m_depthPyramid
+                   : nullptr;
+    }
+
+    // GPU times of the last measured frames, per configuration
+    float depthPrePassMilliseconds() const {
+        return m_depthPrePassTime.milliseconds();
+    }
+
+    float geometryPassMilliseconds(const bool afterDepthPrePass) const {
+        return m_geometryPassTime[afterDepthPrePass].milliseconds();
     }
 
     void bindTextures() {
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        m_lightingPass.use();
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, m_gPosition);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, m_gNormal);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, m_gAlbedoSpec);
+        lightingPassShader().use();
+        GLState::get().bindTexture(0, GL_TEXTURE_2D, m_gPosition);
+        GLState::get().bindTexture(1, GL_TEXTURE_2D, m_gNormal);
+        GLState::get().bindTexture(2, GL_TEXTURE_2D, m_gAlbedoSpec);
+        GLState::get().bindTexture(5, GL_TEXTURE_2D, m_gDepth);
+        if (clusteredLighting()) {
+            m_clustered->bindBuffers();
+            return;
+        }
+        GLState::get().bindTexture(3, GL_TEXTURE_2D, m_lightTiles);
+        GLState::get().bindTexture(4, GL_TEXTURE_BUFFER, m_lightIndices);
     }
 
-    void unbind() const { glBindFramebuffer(GL_FRAMEBUFFER, 0); }
-
-    Shader &geometryPassShader() { return m_geometryPass; }
+    void unbind() const {
+        GLState::get().bindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
 
-    Shader &lightingPassShader() { return m_lightingPass; }
+    // the lighting shader of the active lighting mode and features
+    Shader &lightingPassShader() {
+        ShaderVariants &variants = clusteredLighting()
+                                       ? m_clustered->lightingPasses()
+                                       : m_lightingPass;
+        return variants[m_lightingVariant];
+    }
 
   private:
+    static const unsigned TILE_SIZE = 16;
+
+    // creates a nearest-filtered texture and attaches it to the bound
+    // framebuffer
+    static GLuint attachTexture(
+        const GLenum attachment, const GLint internalFormat,
+        const unsigned width, const unsigned height, const GLenum format,
+        const GLenum type) {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        GLState::get().bindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(
+            GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type,
+            nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glFramebufferTexture2D(
+            GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, texture, 0);
+        return texture;
+    }
+
+    // sets a uniform on every lighting shader, clustered and light volume
+    // ones included
+    template <typename T>
+    void setLightingUniform(const char *name, const T &value) {
+        m_lightingPass.uniform(name, value);
+        if (m_clustered) m_clustered->lightingPasses().uniform(name, value);
+        if (m_lightVolumes)
+            m_lightVolumes->lightingPass().uniform(name, value);
+    }
+
+    // the magic lights come from the volumes unless clustered lighting,
+    // which only uses the stencil mask, has them
+    bool drawsLightVolumes() const {
+        return lightVolumeLighting() && !clusteredLighting();
+    }
+
+    // the G-buffer's depth and stencil are copied first: the full-screen
+    // pass then only shades the pixels the geometry pass marked, zeroing
+    // their stencil as LightVolumes expects, and the volumes are depth
+    // tested against the scene
+    void renderMasked(const GLuint fbo) {
+        GLState::get().bindFramebuffer(GL_READ_FRAMEBUFFER, m_gBuffer);
+        GLState::get().bindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+        glBlitFramebuffer(
+            0, 0, m_width, m_height, 0, 0, m_width, m_height,
+            GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT, GL_NEAREST);
+        GLState::get().bindFramebuffer(GL_FRAMEBUFFER, fbo);
+
+        glEnable(GL_STENCIL_TEST);
+        glStencilFunc(GL_EQUAL, 1, 0xFF);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_ZERO);
+        glDisable(GL_DEPTH_TEST);
+        lightingPassShader().use();
+        GLState::get().bindVertexArray(m_quadVAO);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        glEnable(GL_DEPTH_TEST);
+        if (drawsLightVolumes()) m_lightVolumes->draw(m_volumeLights);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+        glDisable(GL_STENCIL_TEST);
+    }
+
+    // the lights of the MagicLights block whose sphere is on screen
+    void selectLightVolumes(
+        const LightManager &lights, const glm::mat4 &view,
+        const glm::mat4 &projection) {
+        m_lightVolumes->setGpuMotion(lights.gpuMotion());
+        m_volumeLights.clear();
+        for (const auto &light : lights.lights()) {
+            if (light.index() >= LightManager::UNIFORM_LIGHTS) continue;
+            glm::vec3 center;
+            float radius;
+            lights.influence(light, center, radius);
+            TileRect rect {};
+            if (tileRect(center, radius, view, projection, rect))
+                m_volumeLights.push_back(light.index());
+        }
+    }
+
+    // inclusive range of tiles covered by one light
+    struct TileRect {
+        unsigned x0, y0, x1, y1;
+        unsigned index;
+    };
+
+    // projects the light's bounding sphere to a conservative tile range;
+    // returns false if the sphere is behind the camera or off screen
+    bool tileRect(
+        const glm::vec3 &position, const float radius, const glm::mat4 &view,
+        const glm::mat4 &projection, TileRect &rect) const {
+        const glm::vec3 center = glm::vec3(view * glm::vec4(position, 1.0f));
+        // the camera looks down -z; the near plane is at z = -near
+        const float near = projection[3][2] / (projection[2][2] - 1.0f);
+        if (center.z - radius > -near) return false;
+
+        glm::vec2 lo { 1.0f, 1.0f };
+        glm::vec2 hi { -1.0f, -1.0f };
+        if (center.z + radius > -near) {
+            // the sphere crosses the near plane: cover the whole screen
+            lo = glm::vec2(-1.0f, -1.0f);
+            hi = glm::vec2(1.0f, 1.0f);
+        } else {
+            // project the corners of the sphere's view-space bounding box
+            for (int corner = 0; corner < 8; corner++) {
+                const glm::vec4 clip =
+                    projection *
+                    glm::vec4(
+                        center.x + (corner & 1 ? radius : -radius),
+                        center.y + (corner & 2 ? radius : -radius),
+                        center.z + (corner & 4 ? radius : -radius), 1.0f);
+                const float x = clip.x / clip.w;
+                const float y = clip.y / clip.w;
+                lo = glm::vec2(std::min(lo.x, x), std::min(lo.y, y));
+                hi = glm::vec2(std::max(hi.x, x), std::max(hi.y, y));
+            }
+            if (hi.x < -1.0f || hi.y < -1.0f || lo.x > 1.0f || lo.y > 1.0f)
+                return false;
+        }
+
+        const auto tile = [](const float ndc, const unsigned size,
+                             const unsigned tiles) {
+            const float pixel = (0.5f * ndc + 0.5f) * static_cast<float>(size);
+            const int index = static_cast<int>(std::floor(pixel)) /
+                              static_cast<int>(TILE_SIZE);
+            return static_cast<unsigned>(
+                std::min(std::max(index, 0), static_cast<int>(tiles) - 1));
+        };
+        rect.x0 = tile(lo.x, m_width, m_tilesX);
+        rect.x1 = tile(hi.x, m_width, m_tilesX);
+        rect.y0 = tile(lo.y, m_height, m_tilesY);
+        rect.y1 = tile(hi.y, m_height, m_tilesY);
+        return true;
+    }
+
     GLuint m_gBuffer { 0u };
     GLuint m_gPosition { 0u };
     GLuint m_gNormal { 0u };
     GLuint m_gAlbedoSpec { 0u };
-    GLuint m_rboDepth { 0u };
+    GLuint m_gDepth { 0u };
+    bool m_compactGBuffer { false };
 
     unsigned m_width {};
     unsigned m_height {};
@@ -154,8 +584,40 @@ class DeferredShading {
     GLuint m_quadVAO {};
     GLuint m_quadVBO {};
 
-    Shader &m_geometryPass;
-    Shader &m_lightingPass;
+    bool m_tiledLighting { false };
+    unsigned m_tilesX {};
+    unsigned m_tilesY {};
+    GLuint m_lightTiles { 0u };
+    GLuint m_lightIndices { 0u };
+    GLuint m_lightIndexBuffer { 0u };
+    std::vector<GLuint> m_tileRanges;
+    std::vector<GLuint> m_lightIndexList;
+    std::vector<TileRect> m_lightRects;
+
+    ClusteredShading *m_clustered { nullptr };
+    bool m_clusteredLighting { false };
+    VariantUniform<bool> m_clusteredMotion;
+
+    LightVolumes *m_lightVolumes { nullptr };
+    bool m_lightVolumeLighting { false };
+    // MagicLights indices drawn as volumes this frame
+    std::vector<unsigned> m_volumeLights;
+
+    bool m_depthPrePass { false };
+    bool m_inDepthPrePass { false };
+    // whether the running geometry pass follows a depth pre-pass
+    bool m_timedPrePass { false };
+    GpuTimer m_depthPrePassTime;
+    // without and with the depth pre-pass
+    GpuTimer m_geometryPassTime[2];
+
+    DepthPyramid *m_depthPyramid { nullptr };
+    bool m_occlusionCulling { false };
+
+    ShaderVariants &m_lightingPass;
+    VariantUniform<bool> m_lightingMotion;
+    // LightingFeature bits of the active variant
+    unsigned m_lightingVariant { 0u };
 };
 
 #endif // DEFERREDSHADING_H
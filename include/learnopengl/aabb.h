@@ -0,0 +1,51 @@
+#ifndef AABB_H
+#define AABB_H
+
+#include <glm/glm.hpp>
+
+#include <cfloat>
+#include <cmath>
+
+// axis-aligned bounding box; a default constructed box is empty and grows
+// with every point or box added to it
+struct AABB {
+    glm::vec3 min { FLT_MAX, FLT_MAX, FLT_MAX };
+    glm::vec3 max { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+    bool empty() const { return min.x > max.x; }
+
+    void add(const glm::vec3 &point) {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void add(const AABB &box) {
+        if (box.empty()) return;
+        add(box.min);
+        add(box.max);
+    }
+
+    glm::vec3 center() const { return 0.5f * (min + max); }
+
+    glm::vec3 extents() const { return 0.5f * (max - min); }
+
+    // box around this box after an affine transform: the center is
+    // transformed and the extents are projected onto the new axes
+    AABB transformed(const glm::mat4 &model) const {
+        if (empty()) return *this;
+        const glm::vec3 c = glm::vec3(model * glm::vec4(center(), 1.0f));
+        const glm::vec3 e = extents();
+        glm::vec3 r;
+        for (int row = 0; row < 3; row++) {
+            r[row] = std::fabs(model[0][row]) * e.x +
+                     std::fabs(model[1][row]) * e.y +
+                     std::fabs(model[2][row]) * e.z;
+        }
+        AABB box;
+        box.min = c - r;
+        box.max = c + r;
+        return box;
+    }
+};
+
+#endif // AABB_H
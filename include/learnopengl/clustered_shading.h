@@ -0,0 +1,300 @@
+#ifndef CLUSTERED_SHADING_H
+#define CLUSTERED_SHADING_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/gl43.h>
+#include <learnopengl/light_manager.h>
+#include <learnopengl/shader.h>
+#include <learnopengl/shader_variants.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+// Clustered lighting (GL 4.3): the view frustum is split into a
+// GRID_X x GRID_Y x GRID_Z froxel grid with exponential depth slices.
+// cull_lights.comp first keeps the lights whose sphere reaches into the
+// frustum, so the cluster passes cost clusters times visible lights;
+// cluster_lights.comp then assigns each of them to the clusters it
+// touches, and deferred_shading_clustered.frag shades each fragment with the
+// lights of its cluster only. Lights are read from LightManager's storage
+// buffers, so their number is not bound by the MagicLights uniform block.
+//
+// Clusters have no light limit of their own: a counting pass sizes every
+// cluster's range, cluster_offsets.comp lays the ranges out back to back
+// and a second pass fills them. Only the shared index list is bounded; it
+// grows to what the clusters asked for, up to MAX_LIGHT_INDICES. That
+// total reaches the CPU through a ring of READBACK_FRAMES buffers mapped
+// once their fence has passed, so the list grows a frame or two late and
+// update() never waits on the GPU. Until then, clusters past the list's
+// end lose their lights in grid order, which droppedIndices() reports.
+class ClusteredShading {
+
+  public:
+    static const unsigned GRID_X = 16;
+    static const unsigned GRID_Y = 9;
+    static const unsigned GRID_Z = 24;
+    static const unsigned CLUSTER_COUNT = GRID_X * GRID_Y * GRID_Z;
+    // initial size of the shared light index list, per cluster
+    static const unsigned INDICES_PER_CLUSTER = 64;
+    // the list never grows past this many indices (64 MB)
+    static const unsigned MAX_LIGHT_INDICES = 1u << 24;
+    // matches local_size_x in cull_lights.comp and cluster_lights.comp
+    static const unsigned WORK_GROUP_SIZE = 128;
+    // frames a readback of the required index count may take
+    static const unsigned READBACK_FRAMES = 3;
+
+    // `countLights` is cluster_lights.comp built with COUNT_LIGHTS,
+    // `assignLights` the same file without it
+    ClusteredShading(
+        Shader &cullLights, Shader &countLights, Shader &clusterOffsets,
+        Shader &assignLights, ShaderVariants &lightingPass)
+        : m_cullLights { cullLights }
+        , m_countLights { countLights }
+        , m_clusterOffsets { clusterOffsets }
+        , m_assignLights { assignLights }
+        , m_lightingPass { lightingPass }
+        , m_cullZNear { cullLights.handle<float>("zNear") }
+        , m_cullZFar { cullLights.handle<float>("zFar") }
+        , m_cullLightCount { cullLights.handle<unsigned>("lightCount") }
+        , m_cullGpuLightMotion { cullLights.handle<bool>("gpuLightMotion") }
+        , m_countUniforms { countLights }
+        , m_assignUniforms { assignLights }
+        , m_viewportSize { lightingPass.handle<glm::vec2>("viewportSize") }
+        , m_sliceScale { lightingPass.handle<float>("sliceScale") }
+        , m_sliceBias { lightingPass.handle<float>("sliceBias") } {
+        glGenBuffers(3, m_buffers);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffers[CLUSTERS]);
+        glBufferData(
+            GL_SHADER_STORAGE_BUFFER, CLUSTER_COUNT * 2 * sizeof(GLuint),
+            nullptr, GL_DYNAMIC_COPY);
+        allocateLightIndices(CLUSTER_COUNT * INDICES_PER_CLUSTER);
+        allocateVisibleLights(WORK_GROUP_SIZE);
+        glGenBuffers(READBACK_FRAMES, m_readbackBuffers);
+        for (const GLuint buffer : m_readbackBuffers) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            glBufferData(
+                GL_COPY_WRITE_BUFFER, sizeof(GLuint), nullptr, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        const glm::uvec3 grid { GRID_X, GRID_Y, GRID_Z };
+        m_countLights.uniform("clusterGrid", grid);
+        m_clusterOffsets.uniform("clusterGrid", grid);
+        m_assignLights.uniform("clusterGrid", grid);
+        m_lightingPass.uniform("clusterGrid", grid);
+    }
+
+    ClusteredShading(const ClusteredShading &) = delete;
+    ClusteredShading &operator=(const ClusteredShading &) = delete;
+
+    ~ClusteredShading() {
+        for (const GLsync fence : m_readbackFences) {
+            if (fence) glDeleteSync(fence);
+        }
+        glDeleteBuffers(READBACK_FRAMES, m_readbackBuffers);
+        glDeleteBuffers(3, m_buffers);
+    }
+
+    // rebuilds the per-cluster light lists on the GPU for the given
+    // projection and viewport; the view comes from the FrameConstants block.
+    // The lights must have been uploaded to storage already.
+    void update(
+        const LightManager &lights, const glm::mat4 &projection,
+        const unsigned width, const unsigned height) {
+        collectRequiredIndices();
+        if (lights.size() > m_visibleCapacity) {
+            unsigned capacity = m_visibleCapacity;
+            while (capacity < lights.size()) capacity *= 2;
+            allocateVisibleLights(capacity);
+        }
+        if (m_requiredIndices > m_capacity && m_capacity < MAX_LIGHT_INDICES) {
+            unsigned capacity = m_capacity;
+            while (capacity < m_requiredIndices) capacity *= 2;
+            allocateLightIndices(std::min(capacity, MAX_LIGHT_INDICES));
+        }
+
+        // near and far plane recovered from the perspective projection
+        const float zNear = projection[3][2] / (projection[2][2] - 1.0f);
+        const float zFar = projection[3][2] / (projection[2][2] + 1.0f);
+        const glm::vec2 viewport { width, height };
+
+        bindBuffers();
+        const GLuint noLights = 0u;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffers[VISIBLE_LIGHTS]);
+        glBufferSubData(
+            GL_SHADER_STORAGE_BUFFER, VISIBLE_LIGHT_COUNT_OFFSET,
+            sizeof(GLuint), &noLights);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        const unsigned lightCount = static_cast<unsigned>(lights.size());
+        m_cullZNear.set(zNear);
+        m_cullZFar.set(zFar);
+        m_cullLightCount.set(lightCount);
+        m_cullGpuLightMotion.set(lights.gpuMotion());
+        m_cullLights.use();
+        glDispatchCompute(
+            (lightCount + WORK_GROUP_SIZE - 1) / WORK_GROUP_SIZE, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        for (const PassUniforms *pass :
+             { &m_countUniforms, &m_assignUniforms }) {
+            pass->screenSize.set(viewport);
+            pass->zNear.set(zNear);
+            pass->zFar.set(zFar);
+        }
+        const GLuint groups =
+            (CLUSTER_COUNT + WORK_GROUP_SIZE - 1) / WORK_GROUP_SIZE;
+        m_countLights.use();
+        glDispatchCompute(groups, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        m_clusterOffsets.use();
+        glDispatchCompute(1, 1, 1);
+        glMemoryBarrier(
+            GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+        readbackRequiredIndices();
+        m_assignLights.use();
+        glDispatchCompute(groups, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        // slice = log(depth) * sliceScale + sliceBias inverts the
+        // exponential slicing used by the compute pass
+        const float logDepthRange = std::log(zFar / zNear);
+        m_viewportSize.set(viewport);
+        m_sliceScale.set(static_cast<float>(GRID_Z) / logDepthRange);
+        m_sliceBias.set(
+            -static_cast<float>(GRID_Z) * std::log(zNear) / logDepthRange);
+    }
+
+    void bindBuffers() const {
+        for (GLuint buffer = CLUSTERS; buffer <= VISIBLE_LIGHTS; buffer++) {
+            glBindBufferBase(
+                GL_SHADER_STORAGE_BUFFER, buffer + 1, m_buffers[buffer]);
+        }
+    }
+
+    ShaderVariants &lightingPasses() { return m_lightingPass; }
+
+    // light indices the clusters needed in the newest frame read back
+    unsigned requiredIndices() const { return m_requiredIndices; }
+
+    unsigned capacity() const { return m_capacity; }
+
+    // indices that did not fit into the list in that frame
+    unsigned droppedIndices() const {
+        return m_requiredIndices > m_capacity ? m_requiredIndices - m_capacity
+                                              : 0u;
+    }
+
+  private:
+    // owned buffers; each is bound at its index + 1, as declared in
+    // clustered_lights.glsl (binding 0 holds LightManager's positions)
+    enum Buffer { CLUSTERS, LIGHT_INDICES, VISIBLE_LIGHTS };
+
+    // layout of the VisibleLights block: two counters padded to the
+    // 16-byte alignment of the VisibleLight array, then one vec4 and one
+    // uint per light, padded to 32 bytes
+    static const GLintptr VISIBLE_LIGHT_COUNT_OFFSET = sizeof(GLuint);
+    static const GLsizeiptr VISIBLE_LIGHTS_OFFSET = 16;
+    static const GLsizeiptr VISIBLE_LIGHT_STRIDE = 32;
+
+    // copies this frame's required index count into the next buffer of
+    // the ring; a copy still in flight from READBACK_FRAMES frames ago is
+    // given up on
+    void readbackRequiredIndices() {
+        GLsync &fence = m_readbackFences[m_readbackFrame % READBACK_FRAMES];
+        if (fence) glDeleteSync(fence);
+        glBindBuffer(GL_COPY_READ_BUFFER, m_buffers[VISIBLE_LIGHTS]);
+        glBindBuffer(
+            GL_COPY_WRITE_BUFFER,
+            m_readbackBuffers[m_readbackFrame % READBACK_FRAMES]);
+        glCopyBufferSubData(
+            GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(GLuint));
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        m_readbackFrame++;
+    }
+
+    // maps the copies whose fence has passed, oldest first, so the newest
+    // count wins; never waits
+    void collectRequiredIndices() {
+        for (unsigned age = READBACK_FRAMES; age > 0; age--) {
+            const unsigned slot =
+                (m_readbackFrame + READBACK_FRAMES - age) % READBACK_FRAMES;
+            GLsync &fence = m_readbackFences[slot];
+            if (!fence) continue;
+            const GLenum status = glClientWaitSync(fence, 0, 0);
+            if (status != GL_ALREADY_SIGNALED &&
+                status != GL_CONDITION_SATISFIED)
+                continue;
+            glDeleteSync(fence);
+            fence = nullptr;
+            glBindBuffer(GL_COPY_READ_BUFFER, m_readbackBuffers[slot]);
+            const auto *count = static_cast<const GLuint *>(glMapBufferRange(
+                GL_COPY_READ_BUFFER, 0, sizeof(GLuint), GL_MAP_READ_BIT));
+            if (count) {
+                m_requiredIndices = *count;
+                glUnmapBuffer(GL_COPY_READ_BUFFER);
+            }
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    }
+
+    void allocateLightIndices(const unsigned capacity) {
+        m_capacity = capacity;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffers[LIGHT_INDICES]);
+        glBufferData(
+            GL_SHADER_STORAGE_BUFFER, capacity * sizeof(GLuint), nullptr,
+            GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    // room for `capacity` lights that survive culling
+    void allocateVisibleLights(const unsigned capacity) {
+        m_visibleCapacity = capacity;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffers[VISIBLE_LIGHTS]);
+        glBufferData(
+            GL_SHADER_STORAGE_BUFFER,
+            VISIBLE_LIGHTS_OFFSET + capacity * VISIBLE_LIGHT_STRIDE, nullptr,
+            GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    // per-frame uniforms of the counting and the assigning pass
+    struct PassUniforms {
+        explicit PassUniforms(Shader &pass)
+            : screenSize { pass.handle<glm::vec2>("screenSize") }
+            , zNear { pass.handle<float>("zNear") }
+            , zFar { pass.handle<float>("zFar") } {}
+
+        Uniform<glm::vec2> screenSize;
+        Uniform<float> zNear;
+        Uniform<float> zFar;
+    };
+
+    Shader &m_cullLights;
+    Shader &m_countLights;
+    Shader &m_clusterOffsets;
+    Shader &m_assignLights;
+    ShaderVariants &m_lightingPass;
+    Uniform<float> m_cullZNear;
+    Uniform<float> m_cullZFar;
+    Uniform<unsigned> m_cullLightCount;
+    Uniform<bool> m_cullGpuLightMotion;
+    PassUniforms m_countUniforms;
+    PassUniforms m_assignUniforms;
+    VariantUniform<glm::vec2> m_viewportSize;
+    VariantUniform<float> m_sliceScale;
+    VariantUniform<float> m_sliceBias;
+    GLuint m_buffers[3] {};
+    unsigned m_capacity { 0u };
+    unsigned m_visibleCapacity { 0u };
+    GLuint m_requiredIndices { 0u };
+    GLuint m_readbackBuffers[READBACK_FRAMES] {};
+    GLsync m_readbackFences[READBACK_FRAMES] {};
+    unsigned m_readbackFrame { 0u };
+};
+
+#endif // CLUSTERED_SHADING_H
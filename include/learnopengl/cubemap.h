@@ -64,7 +64,7 @@ class CubeMap {
 
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
-        glBindVertexArray(VAO);
+        GLState::get().bindVertexArray(VAO);
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
         glBufferData(
             GL_ARRAY_BUFFER, sizeof(cubeMapVertices), &cubeMapVertices,
@@ -76,15 +76,14 @@ class CubeMap {
         shader.uniform("skybox", 0);
     }
 
-    void draw(const glm::mat4 &view, const glm::mat4 &projection) const {
+    // the camera comes from the FrameConstants block
+    void draw() const {
         glDepthFunc(GL_LEQUAL);
-        m_shader.uniform("view", glm::mat4(glm::mat3(view)));
-        m_shader.uniform("projection", projection);
+        m_shader.use();
 
-        glBindVertexArray(VAO);
+        GLState::get().bindVertexArray(VAO);
         m_texture.activate(0);
         glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
         glDepthFunc(GL_LESS);
     }
 
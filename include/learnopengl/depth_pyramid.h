@@ -0,0 +1,237 @@
+#ifndef DEPTH_PYRAMID_H
+#define DEPTH_PYRAMID_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/gl_state.h>
+#include <learnopengl/occlusion_buffer.h>
+#include <learnopengl/shader.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+// Hierarchical-Z pyramid of a depth buffer: one R32F texture whose level 0
+// is half the depth buffer's size and every texel the farthest depth below
+// it, down to 1x1. depth_pyramid.frag reduces one level into the next; while
+// it renders level i the texture's base and max level are clamped to i - 1,
+// so the pass never samples the level it writes.
+//
+// The first level at most READBACK_WIDTH wide is also copied to the CPU
+// into an OcclusionBuffer. The copies go through a ring of pixel buffers
+// and are only mapped once their fence has passed, so reading back never
+// stalls; occlusion() lags a few frames behind like GpuQuery results.
+class DepthPyramid {
+
+  public:
+    static const unsigned READBACK_WIDTH = 128;
+    static const unsigned LATENCY = 3;
+
+    explicit DepthPyramid(Shader &downsample)
+        : m_downsample { downsample } {
+        glGenBuffers(LATENCY, m_readBuffers);
+        m_downsample.uniform("source", 0);
+    }
+
+    DepthPyramid(const DepthPyramid &) = delete;
+    DepthPyramid &operator=(const DepthPyramid &) = delete;
+
+    ~DepthPyramid() {
+        release();
+        glDeleteBuffers(LATENCY, m_readBuffers);
+    }
+
+    // sizes the pyramid for a depth buffer of width x height
+    void resize(const unsigned width, const unsigned height) {
+        release();
+        unsigned levelWidth = std::max(width / 2, 1u);
+        unsigned levelHeight = std::max(height / 2, 1u);
+        m_sizes.clear();
+        m_sizes.push_back(glm::ivec2(levelWidth, levelHeight));
+        while (levelWidth > 1 || levelHeight > 1) {
+            levelWidth = std::max(levelWidth / 2, 1u);
+            levelHeight = std::max(levelHeight / 2, 1u);
+            m_sizes.push_back(glm::ivec2(levelWidth, levelHeight));
+        }
+        m_readbackLevel = 0;
+        while (static_cast<unsigned>(m_sizes[m_readbackLevel].x) >
+               READBACK_WIDTH)
+            m_readbackLevel++;
+
+        glGenTextures(1, &m_texture);
+        GLState::get().bindTexture(GL_TEXTURE_2D, m_texture);
+        for (std::size_t level = 0; level < m_sizes.size(); level++) {
+            glTexImage2D(
+                GL_TEXTURE_2D, level, GL_R32F, m_sizes[level].x,
+                m_sizes[level].y, 0, GL_RED, GL_FLOAT, nullptr);
+        }
+        glTexParameteri(
+            GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        setLevelRange(0, m_sizes.size() - 1);
+
+        m_framebuffers.assign(m_sizes.size(), 0u);
+        glGenFramebuffers(m_framebuffers.size(), m_framebuffers.data());
+        for (std::size_t level = 0; level < m_sizes.size(); level++) {
+            GLState::get().bindFramebuffer(
+                GL_FRAMEBUFFER, m_framebuffers[level]);
+            glFramebufferTexture2D(
+                GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                m_texture, level);
+        }
+        GLState::get().bindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        const glm::ivec2 &readSize = m_sizes[m_readbackLevel];
+        for (GLuint buffer : m_readBuffers) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+            glBufferData(
+                GL_PIXEL_PACK_BUFFER, readSize.x * readSize.y * sizeof(float),
+                nullptr, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    // reduces `depth`, a depth texture rendered with `viewProjection`, into
+    // the pyramid with full-screen quads of `quadVAO` and starts copying
+    // the readback level to the CPU. Leaves framebuffer 0 bound and the
+    // viewport at the pyramid's last level.
+    void build(
+        const GLuint depth, const glm::mat4 &viewProjection,
+        const GLuint quadVAO) {
+        collect();
+
+        m_downsample.use();
+        GLState::get().bindVertexArray(quadVAO);
+        for (std::size_t level = 0; level < m_sizes.size(); level++) {
+            GLState::get().bindFramebuffer(
+                GL_FRAMEBUFFER, m_framebuffers[level]);
+            glViewport(0, 0, m_sizes[level].x, m_sizes[level].y);
+            if (level == 0) {
+                GLState::get().bindTexture(0, GL_TEXTURE_2D, depth);
+            } else {
+                GLState::get().bindTexture(0, GL_TEXTURE_2D, m_texture);
+                setLevelRange(level - 1, level - 1);
+            }
+            glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        }
+        setLevelRange(0, m_sizes.size() - 1);
+        m_viewProjection = viewProjection;
+        m_built = true;
+
+        // the oldest transfer is given up on if it has not landed yet
+        Transfer &transfer = m_transfers[m_frame % LATENCY];
+        if (transfer.fence) glDeleteSync(transfer.fence);
+        const glm::ivec2 &readSize = m_sizes[m_readbackLevel];
+        GLState::get().bindFramebuffer(
+            GL_READ_FRAMEBUFFER, m_framebuffers[m_readbackLevel]);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_readBuffers[m_frame % LATENCY]);
+        glReadPixels(0, 0, readSize.x, readSize.y, GL_RED, GL_FLOAT, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        GLState::get().bindFramebuffer(GL_FRAMEBUFFER, 0);
+        transfer.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        transfer.viewProjection = viewProjection;
+        m_frame++;
+    }
+
+    // forgets the pyramid and every readback, e.g. after the pyramid was
+    // not built for a while; nothing is occluded until the next build()
+    void invalidate() {
+        for (Transfer &transfer : m_transfers) {
+            if (transfer.fence) glDeleteSync(transfer.fence);
+            transfer.fence = nullptr;
+        }
+        m_occlusion.clear();
+        m_built = false;
+    }
+
+    // whether texture() holds a pyramid built since the last invalidate()
+    bool built() const { return m_built; }
+
+    GLuint texture() const { return m_texture; }
+
+    unsigned levels() const { return m_sizes.size(); }
+
+    // size of level 0
+    glm::ivec2 size() const { return m_sizes.front(); }
+
+    // view-projection of the depth the pyramid was last built from
+    const glm::mat4 &viewProjection() const { return m_viewProjection; }
+
+    // newest readback that reached the CPU
+    const OcclusionBuffer &occlusion() const { return m_occlusion; }
+
+  private:
+    struct Transfer {
+        GLsync fence { nullptr };
+        glm::mat4 viewProjection { 1.0f };
+    };
+
+    void setLevelRange(const GLint base, const GLint max) const {
+        GLState::get().bindTexture(GL_TEXTURE_2D, m_texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, base);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, max);
+    }
+
+    // maps the finished transfers, oldest first, so the newest one ends up
+    // in the occlusion buffer
+    void collect() {
+        const glm::ivec2 &readSize = m_sizes[m_readbackLevel];
+        for (unsigned age = LATENCY; age > 0; age--) {
+            const unsigned slot = (m_frame + LATENCY - age) % LATENCY;
+            Transfer &transfer = m_transfers[slot];
+            if (!transfer.fence) continue;
+            const GLenum status = glClientWaitSync(transfer.fence, 0, 0);
+            if (status != GL_ALREADY_SIGNALED &&
+                status != GL_CONDITION_SATISFIED)
+                continue;
+            glDeleteSync(transfer.fence);
+            transfer.fence = nullptr;
+
+            const std::size_t bytes = readSize.x * readSize.y * sizeof(float);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, m_readBuffers[slot]);
+            const void *depths = glMapBufferRange(
+                GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+            if (depths) {
+                std::memcpy(
+                    m_occlusion.reset(
+                        readSize.x, readSize.y, transfer.viewProjection),
+                    depths, bytes);
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+                m_occlusion.commit();
+            }
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+    }
+
+    // drops the textures, framebuffers and pending transfers of the
+    // current size
+    void release() {
+        invalidate();
+        if (!m_framebuffers.empty()) {
+            GLState::get().deleteFramebuffers(
+                m_framebuffers.size(), m_framebuffers.data());
+        }
+        m_framebuffers.clear();
+        GLState::get().deleteTextures(1, &m_texture);
+        m_texture = 0;
+    }
+
+    Shader &m_downsample;
+    GLuint m_texture { 0u };
+    std::vector<GLuint> m_framebuffers;
+    std::vector<glm::ivec2> m_sizes;
+    unsigned m_readbackLevel { 0u };
+    glm::mat4 m_viewProjection { 1.0f };
+    bool m_built { false };
+
+    GLuint m_readBuffers[LATENCY] {};
+    Transfer m_transfers[LATENCY];
+    unsigned m_frame { 0u };
+    OcclusionBuffer m_occlusion;
+};
+
+#endif // DEPTH_PYRAMID_H
@@ -0,0 +1,85 @@
+#ifndef FRAME_CONSTANTS_H
+#define FRAME_CONSTANTS_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+// Camera, time and scene light parameters shared by every program through
+// the FrameConstants uniform block (frame_constants.glsl). The buffer stays
+// bound at BINDING and Shader assigns the block of every program to it, so
+// a frame costs a single upload instead of per-program uniform calls.
+class FrameConstants {
+
+  public:
+    // uniform buffer binding point; 0 holds LightManager's MagicLights
+    static const GLuint BINDING = 1;
+
+    // std140 layout of the block; members are mat4 or vec4 only
+    struct Data {
+        glm::mat4 projection;
+        glm::mat4 view;
+        glm::mat4 inverseProjection;
+        glm::mat4 inverseView;
+        glm::vec4 viewPosition;
+        glm::vec4 viewDirection;
+        glm::vec4 time; // x: seconds since start, y: last frame's duration
+
+        glm::vec4 dirLightDirection;
+        glm::vec4 dirLightAmbient;
+        glm::vec4 dirLightDiffuse;
+        glm::vec4 dirLightSpecular;
+
+        glm::vec4 pointLightPosition; // w: radius
+        glm::vec4 pointLightAmbient;
+        glm::vec4 pointLightDiffuse;
+        glm::vec4 pointLightSpecular;
+        glm::vec4 pointLightAttenuation; // constant, linear, quadratic
+
+        glm::vec4 spotLightAmbient;
+        glm::vec4 spotLightDiffuse;
+        glm::vec4 spotLightSpecular;
+        glm::vec4 spotLightAttenuation; // constant, linear, quadratic
+        glm::vec4 spotLightCutOff; // inner and outer cosine
+    };
+
+    FrameConstants() {
+        glGenBuffers(1, &m_buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(Data), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, BINDING, m_buffer);
+    }
+
+    FrameConstants(const FrameConstants &) = delete;
+    FrameConstants &operator=(const FrameConstants &) = delete;
+
+    ~FrameConstants() { glDeleteBuffers(1, &m_buffer); }
+
+    // sets the camera members, including the derived inverses
+    void setCamera(
+        const glm::mat4 &view, const glm::mat4 &projection,
+        const glm::vec3 &position, const glm::vec3 &direction) {
+        m_data.view = view;
+        m_data.projection = projection;
+        m_data.inverseView = glm::inverse(view);
+        m_data.inverseProjection = glm::inverse(projection);
+        m_data.viewPosition = glm::vec4(position, 1.0f);
+        m_data.viewDirection = glm::vec4(direction, 0.0f);
+    }
+
+    Data &data() { return m_data; }
+
+    // sends the whole block; call once per frame after filling data()
+    void upload() const {
+        glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Data), &m_data);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+  private:
+    GLuint m_buffer { 0u };
+    Data m_data {};
+};
+
+#endif // FRAME_CONSTANTS_H
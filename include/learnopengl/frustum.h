@@ -0,0 +1,101 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <learnopengl/aabb.h>
+#include <learnopengl/occlusion_buffer.h>
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+
+// View frustum as six planes extracted from a view-projection matrix, used
+// to skip draws whose world-space bounds are entirely off screen, and
+// optionally hidden behind the depth of an OcclusionBuffer. Every test is
+// counted as visible, culled or occluded, per frame like GLState's
+// counters.
+class Frustum {
+
+  public:
+    struct Stats {
+        unsigned long visible { 0ul };
+        unsigned long culled { 0ul };
+        // draws rejected by the occlusion buffer and their triangles
+        unsigned long occluded { 0ul };
+        unsigned long occludedTriangles { 0ul };
+    };
+
+    // planes of the clip-space box -w <= x, y, z <= w (Gribb/Hartmann)
+    void update(const glm::mat4 &viewProjection) {
+        const auto row = [&viewProjection](const int i) {
+            return glm::vec4(
+                viewProjection[0][i], viewProjection[1][i],
+                viewProjection[2][i], viewProjection[3][i]);
+        };
+        m_planes[0] = row(3) + row(0); // left
+        m_planes[1] = row(3) - row(0); // right
+        m_planes[2] = row(3) + row(1); // bottom
+        m_planes[3] = row(3) - row(1); // top
+        m_planes[4] = row(3) + row(2); // near
+        m_planes[5] = row(3) - row(2); // far
+    }
+
+    // true if the world-space box lies entirely outside one of the planes
+    // or is occluded; `triangles` is what the draw would have cost
+    bool cull(const AABB &box, const unsigned long triangles = 0ul) {
+        if (m_enabled && !box.empty() && !intersects(box)) {
+            m_stats.culled++;
+            return true;
+        }
+        if (m_occlusion && m_occlusion->occluded(box)) {
+            m_stats.occluded++;
+            m_stats.occludedTriangles += triangles;
+            return true;
+        }
+        m_stats.visible++;
+        return false;
+    }
+
+    // depth to test the boxes inside the frustum against, null for none
+    void setOcclusion(const OcclusionBuffer *occlusion) {
+        m_occlusion = occlusion;
+    }
+
+    bool intersects(const AABB &box) const {
+        const glm::vec3 center = box.center();
+        const glm::vec3 extents = box.extents();
+        for (const glm::vec4 &plane : m_planes) {
+            // distance of the center against the box's projected radius
+            const float distance = plane.x * center.x + plane.y * center.y +
+                                   plane.z * center.z + plane.w;
+            const float radius = std::fabs(plane.x) * extents.x +
+                                 std::fabs(plane.y) * extents.y +
+                                 std::fabs(plane.z) * extents.z;
+            if (distance < -radius) return false;
+        }
+        return true;
+    }
+
+    bool enabled() const { return m_enabled; }
+
+    // with culling off every test passes, which keeps the counters
+    // comparable
+    void setEnabled(const bool enabled) { m_enabled = enabled; }
+
+    // counters of the previous frame
+    const Stats &frameStats() const { return m_frameStats; }
+
+    void endFrame() {
+        m_frameStats = m_stats;
+        m_stats = Stats {};
+    }
+
+  private:
+    glm::vec4 m_planes[6];
+    bool m_enabled { true };
+    const OcclusionBuffer *m_occlusion { nullptr };
+
+    Stats m_stats;
+    Stats m_frameStats;
+};
+
+#endif // FRUSTUM_H
@@ -0,0 +1,218 @@
+#ifndef GEOMETRY_POOL_H
+#define GEOMETRY_POOL_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/gl_state.h>
+
+#include <cstddef>
+#include <vector>
+
+struct Vertex {
+    // position
+    glm::vec3 Position;
+    // normal
+    glm::vec3 Normal;
+    // texCoords
+    glm::vec2 TexCoords;
+    // tangent
+    glm::vec3 Tangent;
+    // bitangent
+    glm::vec3 Bitangent;
+};
+
+// Vertex and index buffers shared by every Mesh. Each mesh is appended as a
+// range (base vertex, first index) and drawn with glDrawElementsBaseVertex
+// from the same VAO, so drawing one mesh after another never switches
+// vertex arrays. A parallel position-only stream, at the same base vertex,
+// has its own VAO for the depth pre-pass.
+//
+// The buffers grow by doubling; the old contents are copied on the GPU and
+// the VAOs re-pointed, so meshes can be added at any time.
+class GeometryPool {
+
+  public:
+    // where a mesh lives in the pool
+    struct Range {
+        GLint baseVertex;
+        GLuint firstIndex;
+        GLsizei indexCount;
+
+        // byte offset of the first index, as glDrawElements* expects it
+        const void *indexOffset() const {
+            return reinterpret_cast<const void *>(
+                firstIndex * sizeof(unsigned int));
+        }
+    };
+
+    static GeometryPool &get() {
+        static GeometryPool pool;
+        return pool;
+    }
+
+    GeometryPool(const GeometryPool &) = delete;
+    GeometryPool &operator=(const GeometryPool &) = delete;
+
+    // copies a mesh into the pool; indices are relative to its vertices
+    Range add(
+        const std::vector<Vertex> &vertices,
+        const std::vector<unsigned int> &indices) {
+        if (!m_vertexArrays[0]) create();
+
+        std::vector<glm::vec3> positions;
+        positions.reserve(vertices.size());
+        for (const Vertex &vertex : vertices)
+            positions.push_back(vertex.Position);
+
+        const Range range {
+            static_cast<GLint>(m_vertices.size / sizeof(Vertex)),
+            static_cast<GLuint>(m_indices.size / sizeof(unsigned int)),
+            static_cast<GLsizei>(indices.size())
+        };
+        bool grown = append(m_vertices, vertices.data(), vertices.size());
+        grown = append(m_positions, positions.data(), positions.size()) ||
+                grown;
+        grown = append(m_indices, indices.data(), indices.size()) || grown;
+        if (grown) setupVertexArrays();
+        return range;
+    }
+
+    // binds the VAO of the full vertex format or of the positions only
+    void bind(const bool positionsOnly) const {
+        GLState::get().bindVertexArray(m_vertexArrays[positionsOnly]);
+    }
+
+    // binds the VAO like bind() and feeds the per-instance model matrices
+    // of `instanceBuffer` (see InstanceBuffer) to attributes 5-8, one vec4
+    // column each
+    void bind(const bool positionsOnly, const GLuint instanceBuffer) {
+        bind(positionsOnly);
+        GLuint &attached = m_instanceBuffers[positionsOnly];
+        if (attached == instanceBuffer) return;
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        for (unsigned int column = 0; column < 4; column++) {
+            glEnableVertexAttribArray(5 + column);
+            glVertexAttribPointer(
+                5 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                (void *) (column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(5 + column, 1);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        attached = instanceBuffer;
+    }
+
+    // bytes allocated on the GPU for vertices, positions and indices
+    GLsizeiptr capacity() const {
+        return m_vertices.capacity + m_positions.capacity +
+               m_indices.capacity;
+    }
+
+  private:
+    struct Buffer {
+        GLuint id { 0u };
+        GLsizeiptr size { 0 };
+        GLsizeiptr capacity { 0 };
+    };
+
+    GeometryPool() = default;
+
+    void create() {
+        glGenVertexArrays(2, m_vertexArrays);
+        glGenBuffers(1, &m_vertices.id);
+        glGenBuffers(1, &m_positions.id);
+        glGenBuffers(1, &m_indices.id);
+    }
+
+    // appends `count` elements; true if the buffer had to be reallocated
+    template <typename T>
+    static bool append(Buffer &buffer, const T *data, const std::size_t count) {
+        const GLsizeiptr bytes = count * sizeof(T);
+        bool grown = false;
+        if (buffer.size + bytes > buffer.capacity) {
+            GLsizeiptr capacity = buffer.capacity ? buffer.capacity : 1 << 20;
+            while (capacity < buffer.size + bytes)
+                capacity *= 2;
+            grow(buffer, capacity);
+            grown = true;
+        }
+        // the copy targets leave the VAO's element buffer alone
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer.id);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, buffer.size, bytes, data);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        buffer.size += bytes;
+        return grown;
+    }
+
+    static void grow(Buffer &buffer, const GLsizeiptr capacity) {
+        GLuint id = 0;
+        glGenBuffers(1, &id);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+        glBufferData(GL_COPY_WRITE_BUFFER, capacity, nullptr, GL_STATIC_DRAW);
+        if (buffer.size > 0) {
+            glBindBuffer(GL_COPY_READ_BUFFER, buffer.id);
+            glCopyBufferSubData(
+                GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, buffer.size);
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glDeleteBuffers(1, &buffer.id);
+        buffer.id = id;
+        buffer.capacity = capacity;
+    }
+
+    // points both VAOs at the current buffers
+    void setupVertexArrays() {
+        GLState::get().bindVertexArray(m_vertexArrays[0]);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indices.id);
+        glBindBuffer(GL_ARRAY_BUFFER, m_vertices.id);
+        // A great thing about structs is that their memory layout is
+        // sequential for all its items, so the attributes are just offsets
+        // into Vertex.
+        // vertex Positions
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(
+            0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *) nullptr);
+        // vertex normals
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(
+            1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+            (void *) offsetof(Vertex, Normal));
+        // vertex texture coords
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(
+            2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+            (void *) offsetof(Vertex, TexCoords));
+        // vertex tangent
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(
+            3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+            (void *) offsetof(Vertex, Tangent));
+        // vertex bitangent
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(
+            4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+            (void *) offsetof(Vertex, Bitangent));
+
+        // tightly packed positions, 12 instead of 56 bytes per vertex
+        GLState::get().bindVertexArray(m_vertexArrays[1]);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indices.id);
+        glBindBuffer(GL_ARRAY_BUFFER, m_positions.id);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(
+            0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void *) nullptr);
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        GLState::get().bindVertexArray(0);
+    }
+
+    // full vertex format, positions only
+    GLuint m_vertexArrays[2] {};
+    GLuint m_instanceBuffers[2] {};
+    Buffer m_vertices;
+    Buffer m_positions;
+    Buffer m_indices;
+};
+
+#endif // GEOMETRY_POOL_H
@@ -0,0 +1,132 @@
+#ifndef GL43_H
+#define GL43_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+
+// The bundled glad loader only covers the GL 3.3 core profile. This header
+// adds the few GL 4.3 entry points and enums used by the optional compute
+// and multi-draw paths; they are loaded by gl43::load() once a context
+// exists and stay null on 3.3 contexts, so callers must check
+// gl43::supported() first.
+//
+// The program binary entry points (GL 4.1 or ARB_get_program_binary) are
+// loaded independently, see gl43::programBinarySupported().
+
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER 0x91B9
+#endif
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#endif
+#ifndef GL_SHADER_STORAGE_BARRIER_BIT
+#define GL_SHADER_STORAGE_BARRIER_BIT 0x00002000
+#endif
+#ifndef GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT
+#define GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT 0x00000001
+#endif
+#ifndef GL_BUFFER_UPDATE_BARRIER_BIT
+#define GL_BUFFER_UPDATE_BARRIER_BIT 0x00000200
+#endif
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+typedef void(APIENTRYP PFNGLDISPATCHCOMPUTEPROC)(
+    GLuint num_groups_x, GLuint num_groups_y, GLuint num_groups_z);
+typedef void(APIENTRYP PFNGLMEMORYBARRIERPROC)(GLbitfield barriers);
+typedef void(APIENTRYP PFNGLMULTIDRAWELEMENTSINDIRECTPROC)(
+    GLenum mode, GLenum type, const void *indirect, GLsizei drawcount,
+    GLsizei stride);
+typedef void(APIENTRYP PFNGLGETPROGRAMBINARYPROC)(
+    GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat,
+    void *binary);
+typedef void(APIENTRYP PFNGLPROGRAMBINARYPROC)(
+    GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+typedef void(APIENTRYP PFNGLPROGRAMPARAMETERIPROC)(
+    GLuint program, GLenum pname, GLint value);
+
+PFNGLDISPATCHCOMPUTEPROC glDispatchCompute = nullptr;
+PFNGLMEMORYBARRIERPROC glMemoryBarrier = nullptr;
+PFNGLMULTIDRAWELEMENTSINDIRECTPROC glMultiDrawElementsIndirect = nullptr;
+PFNGLGETPROGRAMBINARYPROC glGetProgramBinary = nullptr;
+PFNGLPROGRAMBINARYPROC glProgramBinary = nullptr;
+PFNGLPROGRAMPARAMETERIPROC glProgramParameteri = nullptr;
+
+namespace gl43 {
+
+// true once load() found a 4.3+ context and all entry points resolved
+bool &supported() {
+    static bool loaded { false };
+    return loaded;
+}
+
+// true once load() found program binary support with at least one format
+bool &programBinarySupported() {
+    static bool loaded { false };
+    return loaded;
+}
+
+bool hasExtension(const char *name) {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++) {
+        const auto extension =
+            reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, i));
+        if (extension && std::strcmp(extension, name) == 0) return true;
+    }
+    return false;
+}
+
+bool loadProgramBinary(GLADloadproc loader) {
+    const bool core41 =
+        GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 1);
+    if (!core41 && !hasExtension("GL_ARB_get_program_binary"))
+        return programBinarySupported() = false;
+
+    glGetProgramBinary = reinterpret_cast<PFNGLGETPROGRAMBINARYPROC>(
+        loader("glGetProgramBinary"));
+    glProgramBinary =
+        reinterpret_cast<PFNGLPROGRAMBINARYPROC>(loader("glProgramBinary"));
+    glProgramParameteri = reinterpret_cast<PFNGLPROGRAMPARAMETERIPROC>(
+        loader("glProgramParameteri"));
+
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return programBinarySupported() = glGetProgramBinary && glProgramBinary &&
+                                      glProgramParameteri && formats > 0;
+}
+
+// loads the 4.3 entry points and, on any version, the program binary ones;
+// returns whether 4.3 is supported
+bool load(GLADloadproc loader) {
+    loadProgramBinary(loader);
+    if (GLVersion.major < 4 || (GLVersion.major == 4 && GLVersion.minor < 3))
+        return supported() = false;
+
+    glDispatchCompute =
+        reinterpret_cast<PFNGLDISPATCHCOMPUTEPROC>(loader("glDispatchCompute"));
+    glMemoryBarrier =
+        reinterpret_cast<PFNGLMEMORYBARRIERPROC>(loader("glMemoryBarrier"));
+    glMultiDrawElementsIndirect =
+        reinterpret_cast<PFNGLMULTIDRAWELEMENTSINDIRECTPROC>(
+            loader("glMultiDrawElementsIndirect"));
+
+    return supported() =
+               glDispatchCompute && glMemoryBarrier &&
+               glMultiDrawElementsIndirect;
+}
+
+} // namespace gl43
+
+#endif // GL43_H
@@ -0,0 +1,191 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+
+// Shadow copy of the GL bindings the renderer changes most often (program,
+// VAO, framebuffers, active texture unit and per-unit texture bindings).
+// Binding calls that would not change anything are skipped, and every call is
+// counted as issued or skipped so the savings can be measured.
+//
+// All binds of these kinds must go through GLState, otherwise the shadow copy
+// goes stale; call invalidate() after code that binds behind its back.
+class GLState {
+
+  public:
+    struct Counter {
+        unsigned long issued { 0ul };
+        unsigned long skipped { 0ul };
+    };
+
+    struct Stats {
+        Counter program;
+        Counter vertexArray;
+        Counter framebuffer;
+        Counter activeTexture;
+        Counter texture;
+    };
+
+    static const unsigned MAX_TEXTURE_UNITS = 32;
+
+    static GLState &get() {
+        static GLState state;
+        return state;
+    }
+
+    GLState(const GLState &) = delete;
+    GLState &operator=(const GLState &) = delete;
+
+    void useProgram(const GLuint program) {
+        if (count(m_program == program, m_stats.program)) return;
+        glUseProgram(program);
+        m_program = program;
+    }
+
+    void bindVertexArray(const GLuint vao) {
+        if (count(m_vertexArray == vao, m_stats.vertexArray)) return;
+        glBindVertexArray(vao);
+        m_vertexArray = vao;
+    }
+
+    // target is GL_FRAMEBUFFER, GL_READ_FRAMEBUFFER or GL_DRAW_FRAMEBUFFER
+    void bindFramebuffer(const GLenum target, const GLuint fbo) {
+        const bool read = target != GL_DRAW_FRAMEBUFFER;
+        const bool draw = target != GL_READ_FRAMEBUFFER;
+        const bool bound = (!read || m_readFramebuffer == fbo) &&
+                           (!draw || m_drawFramebuffer == fbo);
+        if (count(bound, m_stats.framebuffer)) return;
+        glBindFramebuffer(target, fbo);
+        if (read) m_readFramebuffer = fbo;
+        if (draw) m_drawFramebuffer = fbo;
+    }
+
+    void activeTexture(const unsigned unit) {
+        if (count(m_activeUnit == unit, m_stats.activeTexture)) return;
+        glActiveTexture(GL_TEXTURE0 + unit);
+        m_activeUnit = unit;
+    }
+
+    // binds to the currently active texture unit
+    void bindTexture(const GLenum target, const GLuint texture) {
+        GLuint *binding = textureBinding(m_activeUnit, target);
+        if (count(binding && *binding == texture, m_stats.texture)) return;
+        glBindTexture(target, texture);
+        if (binding) *binding = texture;
+    }
+
+    // binds to the given unit, switching the active unit only if the
+    // binding actually has to change
+    void bindTexture(
+        const unsigned unit, const GLenum target, const GLuint texture) {
+        GLuint *binding = textureBinding(unit, target);
+        if (binding && *binding == texture) {
+            count(true, m_stats.texture);
+            return;
+        }
+        activeTexture(unit);
+        bindTexture(target, texture);
+    }
+
+    // GL unbinds deleted objects; forget them so a recycled name isn't
+    // mistaken for a current binding
+    void deleteProgram(const GLuint program) {
+        glDeleteProgram(program);
+        if (m_program == program) m_program = 0;
+    }
+
+    void deleteVertexArrays(const GLsizei n, const GLuint *vaos) {
+        glDeleteVertexArrays(n, vaos);
+        for (GLsizei i = 0; i < n; i++) {
+            if (m_vertexArray == vaos[i]) m_vertexArray = 0;
+        }
+    }
+
+    void deleteFramebuffers(const GLsizei n, const GLuint *fbos) {
+        glDeleteFramebuffers(n, fbos);
+        for (GLsizei i = 0; i < n; i++) {
+            if (fbos[i] == 0) continue;
+            if (m_readFramebuffer == fbos[i]) m_readFramebuffer = 0;
+            if (m_drawFramebuffer == fbos[i]) m_drawFramebuffer = 0;
+        }
+    }
+
+    void deleteTextures(const GLsizei n, const GLuint *textures) {
+        glDeleteTextures(n, textures);
+        for (auto &unit : m_textures) {
+            for (GLuint &binding : unit) {
+                if (std::find(textures, textures + n, binding) !=
+                    textures + n)
+                    binding = 0;
+            }
+        }
+    }
+
+    // forget everything; the next bind of each kind is always issued
+    void invalidate() {
+        m_program = UNKNOWN;
+        m_vertexArray = UNKNOWN;
+        m_readFramebuffer = UNKNOWN;
+        m_drawFramebuffer = UNKNOWN;
+        m_activeUnit = UNKNOWN;
+        for (auto &unit : m_textures) {
+            std::fill(std::begin(unit), std::end(unit), GLuint { UNKNOWN });
+        }
+    }
+
+    // counters since the last endFrame()
+    const Stats &stats() const { return m_stats; }
+
+    // counters of the previous frame
+    const Stats &frameStats() const { return m_frameStats; }
+
+    void endFrame() {
+        m_frameStats = m_stats;
+        m_stats = Stats {};
+    }
+
+  private:
+    static const GLuint UNKNOWN = ~0u;
+
+    GLState() { invalidate(); }
+
+    static bool count(const bool redundant, Counter &counter) {
+        if (redundant) {
+            counter.skipped++;
+        } else {
+            counter.issued++;
+        }
+        return redundant;
+    }
+
+    // shadow slot for a unit/target pair, nullptr for untracked targets
+    GLuint *textureBinding(const unsigned unit, const GLenum target) {
+        if (unit >= MAX_TEXTURE_UNITS) return nullptr;
+        switch (target) {
+            case GL_TEXTURE_2D:
+                return &m_textures[unit][0];
+            case GL_TEXTURE_CUBE_MAP:
+                return &m_textures[unit][1];
+            case GL_TEXTURE_BUFFER:
+                return &m_textures[unit][2];
+            case GL_TEXTURE_2D_ARRAY:
+                return &m_textures[unit][3];
+            default:
+                return nullptr;
+        }
+    }
+
+    GLuint m_program {};
+    GLuint m_vertexArray {};
+    GLuint m_readFramebuffer {};
+    GLuint m_drawFramebuffer {};
+    unsigned m_activeUnit {};
+    GLuint m_textures[MAX_TEXTURE_UNITS][4] {};
+
+    Stats m_stats;
+    Stats m_frameStats;
+};
+
+#endif // GL_STATE_H
@@ -0,0 +1,131 @@
+#ifndef GPU_CULLING_H
+#define GPU_CULLING_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/aabb.h>
+#include <learnopengl/depth_pyramid.h>
+#include <learnopengl/gl43.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/shader.h>
+
+#include <vector>
+
+// Frustum culling of instances on the GPU (GL 4.3). The model matrices of
+// all instances are uploaded once; every frame cull_instances.comp tests
+// each instance's world-space box against the frustum of the FrameConstants
+// block, and optionally against a DepthPyramid, and appends the survivors
+// to the visible buffer, which is read through attributes 5-8 like an
+// InstanceBuffer.
+//
+// The number of survivors never leaves the GPU: the render queue copies it
+// into the instanceCount of indirect draw commands, so after setup the CPU
+// does not touch per-instance data at all.
+class GpuCulling {
+
+  public:
+    // matches local_size_x in cull_instances.comp
+    static const unsigned WORK_GROUP_SIZE = 256;
+
+    // `bounds` is the object-space box shared by all instances
+    GpuCulling(Shader &cullInstances, const AABB &bounds)
+        : m_cullInstances { cullInstances }
+        , m_instanceCount { cullInstances.handle<unsigned>("instanceCount") }
+        , m_cullingEnabled { cullInstances.handle<bool>("cullingEnabled") }
+        , m_occlusionCulling {
+            cullInstances.handle<bool>("occlusionCulling")
+        }
+        , m_pyramidViewProjection {
+            cullInstances.handle<glm::mat4>("pyramidViewProjection")
+        }
+        , m_pyramidLevels { cullInstances.handle<int>("pyramidLevels") } {
+        glGenBuffers(3, m_buffers);
+        m_cullInstances.uniform("depthPyramid", static_cast<int>(PYRAMID_UNIT));
+        m_cullInstances.uniform("boundsCenter", bounds.center());
+        m_cullInstances.uniform("boundsExtents", bounds.extents());
+    }
+
+    GpuCulling(const GpuCulling &) = delete;
+    GpuCulling &operator=(const GpuCulling &) = delete;
+
+    ~GpuCulling() { glDeleteBuffers(3, m_buffers); }
+
+    // replaces all instances; the visible buffer is sized for all of them
+    void setInstances(const std::vector<glm::mat4> &models) {
+        m_count = models.size();
+        const GLsizeiptr bytes = models.size() * sizeof(glm::mat4);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffers[INSTANCES]);
+        glBufferData(
+            GL_SHADER_STORAGE_BUFFER, bytes, models.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffers[VISIBLE]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, bytes, nullptr, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffers[VISIBLE_COUNT]);
+        glBufferData(
+            GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), nullptr,
+            GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    // rebuilds the visible buffer for the frustum of the current
+    // FrameConstants; disabled culling keeps every instance. With a
+    // `pyramid`, instances hidden behind its depth are culled as well.
+    void cull(const bool enabled, const DepthPyramid *pyramid = nullptr) {
+        if (m_count == 0) return;
+        const GLuint zero = 0;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffers[VISIBLE_COUNT]);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zero), &zero);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        for (GLuint buffer = INSTANCES; buffer <= VISIBLE_COUNT; buffer++) {
+            glBindBufferBase(
+                GL_SHADER_STORAGE_BUFFER, FIRST_BINDING + buffer,
+                m_buffers[buffer]);
+        }
+        m_instanceCount.set(m_count);
+        m_cullingEnabled.set(enabled);
+        m_occlusionCulling.set(pyramid != nullptr);
+        if (pyramid) {
+            GLState::get().bindTexture(
+                PYRAMID_UNIT, GL_TEXTURE_2D, pyramid->texture());
+            m_pyramidViewProjection.set(pyramid->viewProjection());
+            m_pyramidLevels.set(static_cast<int>(pyramid->levels()));
+        }
+        m_cullInstances.use();
+        glDispatchCompute(
+            (m_count + WORK_GROUP_SIZE - 1) / WORK_GROUP_SIZE, 1, 1);
+        // the survivors are read as vertex attributes, their count by a
+        // buffer copy into the draw commands
+        glMemoryBarrier(
+            GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    }
+
+    // buffer of the visible instances' model matrices
+    GLuint id() const { return m_buffers[VISIBLE]; }
+
+    // buffer holding the number of visible instances as one GLuint
+    GLuint countBuffer() const { return m_buffers[VISIBLE_COUNT]; }
+
+    // number of instances before culling
+    unsigned count() const { return m_count; }
+
+  private:
+    // owned buffers; each is bound at FIRST_BINDING + its index, as declared
+    // in cull_instances.comp (LightManager and ClusteredShading use 0-4)
+    enum Buffer { INSTANCES, VISIBLE, VISIBLE_COUNT };
+    static const GLuint FIRST_BINDING = 5;
+    // texture unit of the depth pyramid, above the G-buffer's
+    static const unsigned PYRAMID_UNIT = 6;
+
+    Shader &m_cullInstances;
+    Uniform<unsigned> m_instanceCount;
+    Uniform<bool> m_cullingEnabled;
+    Uniform<bool> m_occlusionCulling;
+    Uniform<glm::mat4> m_pyramidViewProjection;
+    Uniform<int> m_pyramidLevels;
+    GLuint m_buffers[3] {};
+    unsigned m_count { 0u };
+};
+
+#endif // GPU_CULLING_H
@@ -0,0 +1,67 @@
+#ifndef GPU_QUERY_H
+#define GPU_QUERY_H
+
+#include <glad/glad.h>
+
+// A query object of one target (GL_SAMPLES_PASSED, GL_TIME_ELAPSED, ...)
+// begun and ended once per frame. The queries rotate through LATENCY
+// objects and a result is only read back once the GPU has it, so measuring
+// never stalls the pipeline; result() lags a few frames behind.
+class GpuQuery {
+
+  public:
+    static const unsigned LATENCY = 3;
+
+    explicit GpuQuery(const GLenum target)
+        : m_target { target } {
+        glGenQueries(LATENCY, m_queries);
+    }
+
+    GpuQuery(const GpuQuery &) = delete;
+    GpuQuery &operator=(const GpuQuery &) = delete;
+
+    ~GpuQuery() { glDeleteQueries(LATENCY, m_queries); }
+
+    void begin() {
+        const GLuint query = m_queries[m_frame % LATENCY];
+        // collect the result this query object held LATENCY frames ago
+        if (m_frame >= LATENCY) {
+            GLuint available = GL_FALSE;
+            glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available)
+                glGetQueryObjectui64v(query, GL_QUERY_RESULT, &m_result);
+        }
+        glBeginQuery(m_target, query);
+    }
+
+    void end() {
+        glEndQuery(m_target);
+        m_frame++;
+    }
+
+    // latest available result: samples, nanoseconds, ... by target
+    GLuint64 result() const { return m_result; }
+
+  private:
+    GLenum m_target;
+    GLuint m_queries[LATENCY] {};
+    unsigned m_frame { 0u };
+    GLuint64 m_result { 0u };
+};
+
+// GPU time of the commands between begin() and end(); only one timer may
+// be running at a time
+class GpuTimer {
+
+  public:
+    void begin() { m_query.begin(); }
+
+    void end() { m_query.end(); }
+
+    float milliseconds() const { return m_query.result() / 1.0e6f; }
+
+  private:
+    GpuQuery m_query { GL_TIME_ELAPSED };
+};
+
+#endif // GPU_QUERY_H
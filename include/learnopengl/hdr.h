@@ -3,15 +3,33 @@
 
 #include <glad/glad.h>
 
+#include <learnopengl/gl_state.h>
 #include <learnopengl/shader.h>
+#include <learnopengl/shader_variants.h>
 
+#include <algorithm>
 #include <iostream>
 
 class HDR {
 
   public:
+    // Gaussian: 10 separable blur passes at full resolution.
+    // MipChain: progressive downsample of the bright-pass buffer through
+    // half-resolution targets, then tent-filtered upsampling back up.
+    enum class BloomMode { Gaussian, MipChain };
+
+    static const unsigned BLOOM_MIPS = 6;
+
+    // auto exposure: the scene's log luminance is rendered at this size and
+    // mipmapped down to its average
+    static const unsigned LUMINANCE_SIZE = 256;
+    static const unsigned LUMINANCE_LEVELS = 9; // log2(LUMINANCE_SIZE) + 1
+    // frames an exposure readback may take before it is collected
+    static const unsigned READBACK_FRAMES = 3;
+
     HDR(const unsigned width, const unsigned height) {
         resize(width, height);
+        createExposureTargets();
 
         float quadVertices[] = {
             -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, -1.0f, -1.0f, 0.0f, 0.0f, 0.0f,
@@ -19,7 +37,7 @@ class HDR {
         };
         glGenVertexArrays(1, &m_quadVAO);
         glGenBuffers(1, &m_quadVBO);
-        glBindVertexArray(m_quadVBO);
+        GLState::get().bindVertexArray(m_quadVAO);
         glBindBuffer(GL_ARRAY_BUFFER, m_quadVBO);
         glBufferData(
             GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices,
@@ -33,17 +51,44 @@ class HDR {
             (void *) (3 * sizeof(float)));
     }
 
+    // the post-processing programs, needed before the first
+    // adaptExposure(), blur() or bloom(). Their constant uniforms are set
+    // here and the per-frame ones resolved into handles.
+    void setShaders(
+        Shader &blur, Shader &downsample, Shader &upsample, Shader &luminance,
+        Shader &adapt, ShaderVariants &bloom) {
+        m_blurShader = &blur;
+        m_downsampleShader = &downsample;
+        m_upsampleShader = &upsample;
+        m_luminanceShader = &luminance;
+        m_adaptShader = &adapt;
+        m_bloomShaders = &bloom;
+
+        upsample.uniform("filterRadius", 1.0f);
+        adapt.uniform("lastLevel", static_cast<float>(LUMINANCE_LEVELS - 1));
+        adapt.uniform("adaptationSpeed", 1.5f);
+        adapt.uniform("minLuminance", 0.1f);
+        adapt.uniform("maxLuminance", 8.0f);
+        bloom.uniform("keyValue", KEY_VALUE);
+        m_bloomFeature = bloom.feature("BLOOM");
+
+        m_horizontalUniform = blur.handle<bool>("horizontal");
+        m_deltaTime = adapt.handle<float>("deltaTime");
+        m_bloomStrength = bloom[m_bloomFeature].handle<float>("bloomStrength");
+        m_bloomExposure = bloom.handle<float>("exposure");
+        m_bloomAutoExposure = bloom.handle<bool>("autoExposure");
+    }
+
     void bind() {
-        glBindFramebuffer(GL_FRAMEBUFFER, m_FBO);
+        GLState::get().bindFramebuffer(GL_FRAMEBUFFER, m_FBO);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     }
 
-    void unbind() { glBindFramebuffer(GL_FRAMEBUFFER, 0); }
+    void unbind() { GLState::get().bindFramebuffer(GL_FRAMEBUFFER, 0); }
 
     void render(Shader &shader) {
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, m_colorBuffer[0]);
+        GLState::get().bindTexture(0, GL_TEXTURE_2D, m_colorBuffer[0]);
         shader.uniform("hdr", m_is_hdr);
         shader.uniform("exposure", m_exposure);
 
@@ -51,21 +96,27 @@ class HDR {
     }
 
     void resize(const unsigned width, const unsigned height) {
-        glDeleteFramebuffers(1, &m_FBO);
-        glDeleteTextures(2, m_colorBuffer);
+        GLState::get().deleteFramebuffers(1, &m_FBO);
+        GLState::get().deleteTextures(2, m_colorBuffer);
         glDeleteRenderbuffers(1, &m_rboDepth);
 
-        glDeleteFramebuffers(2, m_pingpongFBO);
-        glDeleteTextures(2, m_pingpongColorbuffers);
+        GLState::get().deleteFramebuffers(2, m_pingpongFBO);
+        GLState::get().deleteTextures(2, m_pingpongColorbuffers);
+
+        GLState::get().deleteFramebuffers(BLOOM_MIPS, m_mipFBO);
+        GLState::get().deleteTextures(BLOOM_MIPS, m_mipColorbuffers);
+
+        m_width = width;
+        m_height = height;
 
         // configure (floating point) framebuffers
         glGenFramebuffers(1, &m_FBO);
-        glBindFramebuffer(GL_FRAMEBUFFER, m_FBO);
+        GLState::get().bindFramebuffer(GL_FRAMEBUFFER, m_FBO);
         // create 2 floating point color buffers (1 for normal rendering, other
         // for brightness threshold values)
         glGenTextures(2, m_colorBuffer);
         for (unsigned int i = 0; i < 2; i++) {
-            glBindTexture(GL_TEXTURE_2D, m_colorBuffer[i]);
+            GLState::get().bindTexture(GL_TEXTURE_2D, m_colorBuffer[i]);
             glTexImage2D(
                 GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA,
                 GL_FLOAT, nullptr);
@@ -85,10 +136,12 @@ class HDR {
         // create and attach depth buffer (renderbuffer)
         glGenRenderbuffers(1, &m_rboDepth);
         glBindRenderbuffer(GL_RENDERBUFFER, m_rboDepth);
+        // sized to match the G-buffer depth and stencil blitted into it
         glRenderbufferStorage(
-            GL_RENDERBUFFER, GL_DEPTH_COMPONENT, width, height);
+            GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
         glFramebufferRenderbuffer(
-            GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_rboDepth);
+            GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER,
+            m_rboDepth);
         // tell OpenGL which color attachments we'll use (of this framebuffer)
         // for rendering
         unsigned attachments[2] = { GL_COLOR_ATTACHMENT0,
@@ -97,14 +150,15 @@ class HDR {
         // finally check if framebuffer is complete
         if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
             std::cout << "Framebuffer not complete!" << std::endl;
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        GLState::get().bindFramebuffer(GL_FRAMEBUFFER, 0);
 
         // ping-pong-framebuffer for blurring
         glGenFramebuffers(2, m_pingpongFBO);
         glGenTextures(2, m_pingpongColorbuffers);
         for (unsigned int i = 0; i < 2; i++) {
-            glBindFramebuffer(GL_FRAMEBUFFER, m_pingpongFBO[i]);
-            glBindTexture(GL_TEXTURE_2D, m_pingpongColorbuffers[i]);
+            GLState::get().bindFramebuffer(GL_FRAMEBUFFER, m_pingpongFBO[i]);
+            GLState::get().bindTexture(
+                GL_TEXTURE_2D, m_pingpongColorbuffers[i]);
             glTexImage2D(
                 GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA,
                 GL_FLOAT, nullptr);
@@ -125,7 +179,28 @@ class HDR {
                 GL_FRAMEBUFFER_COMPLETE)
                 std::cout << "Framebuffer not complete!" << std::endl;
         }
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        // bloom mip chain, each level half the size of the previous one
+        glGenFramebuffers(BLOOM_MIPS, m_mipFBO);
+        glGenTextures(BLOOM_MIPS, m_mipColorbuffers);
+        for (unsigned int i = 0; i < BLOOM_MIPS; i++) {
+            GLState::get().bindFramebuffer(GL_FRAMEBUFFER, m_mipFBO[i]);
+            GLState::get().bindTexture(GL_TEXTURE_2D, m_mipColorbuffers[i]);
+            glTexImage2D(
+                GL_TEXTURE_2D, 0, GL_R11F_G11F_B10F, mipWidth(i),
+                mipHeight(i), 0, GL_RGB, GL_FLOAT, nullptr);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glFramebufferTexture2D(
+                GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                m_mipColorbuffers[i], 0);
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) !=
+                GL_FRAMEBUFFER_COMPLETE)
+                std::cout << "Framebuffer not complete!" << std::endl;
+        }
+        GLState::get().bindFramebuffer(GL_FRAMEBUFFER, 0);
     }
 
     float exposure() const { return m_exposure; }
@@ -140,18 +215,73 @@ class HDR {
 
     void setBloomState(const bool state) { m_is_bloom = state; }
 
+    bool autoExposure() const { return m_autoExposure; }
+
+    void setAutoExposure(const bool enabled) { m_autoExposure = enabled; }
+
+    // exposure applied by the last collected readback, a few frames old;
+    // only for display, tone mapping reads the adapted luminance on the GPU
+    float measuredExposure() const {
+        return m_exposure * KEY_VALUE / std::max(m_measuredLuminance, 1e-4f);
+    }
+
+    // measures the average luminance of the rendered scene and adapts the
+    // exposure towards it; everything stays on the GPU
+    void adaptExposure(const float deltaTime) {
+        if (!m_autoExposure) return;
+
+        // log luminance of the scene, averaged by the mip chain
+        m_luminanceShader->use();
+        GLState::get().bindFramebuffer(GL_FRAMEBUFFER, m_luminanceFBO);
+        glViewport(0, 0, LUMINANCE_SIZE, LUMINANCE_SIZE);
+        GLState::get().bindTexture(0, GL_TEXTURE_2D, m_colorBuffer[0]);
+        renderQuad();
+        GLState::get().bindTexture(0, GL_TEXTURE_2D, m_luminance);
+        glGenerateMipmap(GL_TEXTURE_2D);
+
+        // blend the average into last frame's adapted luminance
+        const unsigned previous = m_adaptedIndex;
+        m_adaptedIndex = 1 - m_adaptedIndex;
+        m_adaptShader->use();
+        m_deltaTime.set(deltaTime);
+        GLState::get().bindFramebuffer(
+            GL_FRAMEBUFFER, m_adaptedFBO[m_adaptedIndex]);
+        glViewport(0, 0, 1, 1);
+        GLState::get().bindTexture(
+            1, GL_TEXTURE_2D, m_adaptedLuminance[previous]);
+        renderQuad();
+
+        readbackExposure();
+
+        glViewport(0, 0, m_width, m_height);
+        GLState::get().bindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    BloomMode bloomMode() const { return m_bloomMode; }
+
+    void setBloomMode(const BloomMode mode) { m_bloomMode = mode; }
+
     GLuint buffer() const { return m_FBO; }
 
-    void blur(Shader &shaderBlur) {
+    // blurs the bright-pass buffer with the active bloom mode; does nothing
+    // while bloom is off
+    void blur() {
+        if (!m_is_bloom) return;
+        if (m_bloomMode == BloomMode::MipChain) {
+            blurMipChain();
+            return;
+        }
+
         m_horizontal = true;
         bool first_iteration = true;
         unsigned int amount = 10;
-        shaderBlur.use();
+        m_blurShader->use();
         for (unsigned int i = 0; i < amount; i++) {
-            glBindFramebuffer(GL_FRAMEBUFFER, m_pingpongFBO[m_horizontal]);
-            shaderBlur.uniform("horizontal", m_horizontal);
-            glBindTexture(
-                GL_TEXTURE_2D,
+            GLState::get().bindFramebuffer(
+                GL_FRAMEBUFFER, m_pingpongFBO[m_horizontal]);
+            m_horizontalUniform.set(m_horizontal);
+            GLState::get().bindTexture(
+                0, GL_TEXTURE_2D,
                 first_iteration
                     ? m_colorBuffer[1]
                     : m_pingpongColorbuffers
@@ -161,26 +291,155 @@ class HDR {
             m_horizontal = !m_horizontal;
             first_iteration = false;
         }
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        GLState::get().bindFramebuffer(GL_FRAMEBUFFER, 0);
     }
 
-    void bloom(Shader &shaderBloom) {
+    // tone maps the scene with the BLOOM variant of the bloom shaders when
+    // bloom is on
+    void bloom() {
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        Shader &shaderBloom =
+            (*m_bloomShaders)[m_is_bloom ? m_bloomFeature : 0];
+        GLState::get().bindTexture(0, GL_TEXTURE_2D, m_colorBuffer[0]);
+        const bool mipChain = m_bloomMode == BloomMode::MipChain;
+        GLState::get().bindTexture(
+            1, GL_TEXTURE_2D,
+            mipChain ? m_mipColorbuffers[0]
+                     : m_pingpongColorbuffers[!m_horizontal]);
+        // the upsampled mip chain holds the sum of all its levels
+        if (m_is_bloom)
+            m_bloomStrength.set(mipChain ? 1.0f / BLOOM_MIPS : 1.0f);
+        m_bloomExposure.set(m_exposure);
+        GLState::get().bindTexture(
+            2, GL_TEXTURE_2D, m_adaptedLuminance[m_adaptedIndex]);
+        m_bloomAutoExposure.set(m_autoExposure);
+        // the variant handles switch programs
         shaderBloom.use();
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, m_colorBuffer[0]);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, m_pingpongColorbuffers[!m_horizontal]);
-        shaderBloom.uniform("bloom", m_is_bloom);
-        shaderBloom.uniform("exposure", m_exposure);
         renderQuad();
     }
 
   private:
+    // middle grey the adapted luminance is mapped to
+    static constexpr float KEY_VALUE = 0.18f;
+
+    // size independent, so created once instead of in resize()
+    void createExposureTargets() {
+        glGenFramebuffers(1, &m_luminanceFBO);
+        glGenTextures(1, &m_luminance);
+        GLState::get().bindFramebuffer(GL_FRAMEBUFFER, m_luminanceFBO);
+        GLState::get().bindTexture(GL_TEXTURE_2D, m_luminance);
+        glTexImage2D(
+            GL_TEXTURE_2D, 0, GL_R16F, LUMINANCE_SIZE, LUMINANCE_SIZE, 0,
+            GL_RED, GL_FLOAT, nullptr);
+        glTexParameteri(
+            GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glFramebufferTexture2D(
+            GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_luminance,
+            0);
+
+        // adapted luminance, ping-ponged between two 1x1 targets; starts
+        // at the key value, i.e. at the manual exposure
+        const float initial = KEY_VALUE;
+        glGenFramebuffers(2, m_adaptedFBO);
+        glGenTextures(2, m_adaptedLuminance);
+        for (unsigned int i = 0; i < 2; i++) {
+            GLState::get().bindFramebuffer(GL_FRAMEBUFFER, m_adaptedFBO[i]);
+            GLState::get().bindTexture(GL_TEXTURE_2D, m_adaptedLuminance[i]);
+            glTexImage2D(
+                GL_TEXTURE_2D, 0, GL_R32F, 1, 1, 0, GL_RED, GL_FLOAT,
+                &initial);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glFramebufferTexture2D(
+                GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                m_adaptedLuminance[i], 0);
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) !=
+                GL_FRAMEBUFFER_COMPLETE)
+                std::cout << "Framebuffer not complete!" << std::endl;
+        }
+        GLState::get().bindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        glGenBuffers(READBACK_FRAMES, m_readbackPBO);
+        for (unsigned int i = 0; i < READBACK_FRAMES; i++) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, m_readbackPBO[i]);
+            glBufferData(
+                GL_PIXEL_PACK_BUFFER, sizeof(float), nullptr, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    // copies the adapted luminance into a ring of pixel buffers and
+    // collects the copy made READBACK_FRAMES frames ago once its fence has
+    // signalled; never waits on the GPU
+    void readbackExposure() {
+        GLsync &fence = m_readbackFence[m_readbackIndex];
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_readbackPBO[m_readbackIndex]);
+        if (fence) {
+            if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+                // still in flight, try again next frame
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+                return;
+            }
+            glDeleteSync(fence);
+            fence = nullptr;
+            const auto *luminance = static_cast<const float *>(
+                glMapBufferRange(
+                    GL_PIXEL_PACK_BUFFER, 0, sizeof(float), GL_MAP_READ_BIT));
+            if (luminance) {
+                m_measuredLuminance = *luminance;
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            }
+        }
+        GLState::get().bindFramebuffer(
+            GL_READ_FRAMEBUFFER, m_adaptedFBO[m_adaptedIndex]);
+        glReadPixels(0, 0, 1, 1, GL_RED, GL_FLOAT, nullptr);
+        fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        m_readbackIndex = (m_readbackIndex + 1) % READBACK_FRAMES;
+    }
+
+    void blurMipChain() {
+        m_downsampleShader->use();
+        for (unsigned int i = 0; i < BLOOM_MIPS; i++) {
+            GLState::get().bindFramebuffer(GL_FRAMEBUFFER, m_mipFBO[i]);
+            glViewport(0, 0, mipWidth(i), mipHeight(i));
+            // the first level reads the full-resolution bright-pass buffer
+            GLState::get().bindTexture(
+                0, GL_TEXTURE_2D,
+                i == 0 ? m_colorBuffer[1] : m_mipColorbuffers[i - 1]);
+            renderQuad();
+        }
+
+        // walk back up, adding each level onto the next larger one
+        m_upsampleShader->use();
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+        for (unsigned int i = BLOOM_MIPS - 1; i > 0; i--) {
+            GLState::get().bindFramebuffer(GL_FRAMEBUFFER, m_mipFBO[i - 1]);
+            glViewport(0, 0, mipWidth(i - 1), mipHeight(i - 1));
+            GLState::get().bindTexture(0, GL_TEXTURE_2D, m_mipColorbuffers[i]);
+            renderQuad();
+        }
+        glDisable(GL_BLEND);
+
+        glViewport(0, 0, m_width, m_height);
+        GLState::get().bindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // size of bloom mip level i, level 0 being half the screen
+    unsigned mipWidth(const unsigned level) const {
+        return std::max(m_width >> (level + 1), 1u);
+    }
+
+    unsigned mipHeight(const unsigned level) const {
+        return std::max(m_height >> (level + 1), 1u);
+    }
+
     void renderQuad() const {
-        glBindVertexArray(m_quadVAO);
+        GLState::get().bindVertexArray(m_quadVAO);
         glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-        glBindVertexArray(0);
     }
 
     GLuint m_FBO { 0u };
@@ -191,9 +450,40 @@ class HDR {
     GLuint m_pingpongColorbuffers[2] { 0u, 0u };
     bool m_horizontal { true };
 
+    GLuint m_mipFBO[BLOOM_MIPS] {};
+    GLuint m_mipColorbuffers[BLOOM_MIPS] {};
+    BloomMode m_bloomMode { BloomMode::MipChain };
+
+    unsigned m_width { 0u };
+    unsigned m_height { 0u };
+
+    bool m_autoExposure { true };
+    GLuint m_luminanceFBO { 0u };
+    GLuint m_luminance { 0u };
+    GLuint m_adaptedFBO[2] { 0u, 0u };
+    GLuint m_adaptedLuminance[2] { 0u, 0u };
+    unsigned m_adaptedIndex { 0u };
+    GLuint m_readbackPBO[READBACK_FRAMES] {};
+    GLsync m_readbackFence[READBACK_FRAMES] {};
+    unsigned m_readbackIndex { 0u };
+    float m_measuredLuminance { KEY_VALUE };
+
     GLuint m_quadVAO { 0u };
     GLuint m_quadVBO { 0u };
 
+    Shader *m_blurShader { nullptr };
+    Shader *m_downsampleShader { nullptr };
+    Shader *m_upsampleShader { nullptr };
+    Shader *m_luminanceShader { nullptr };
+    Shader *m_adaptShader { nullptr };
+    ShaderVariants *m_bloomShaders { nullptr };
+    unsigned m_bloomFeature { 0u };
+    Uniform<bool> m_horizontalUniform;
+    Uniform<float> m_deltaTime;
+    Uniform<float> m_bloomStrength;
+    VariantUniform<float> m_bloomExposure;
+    VariantUniform<bool> m_bloomAutoExposure;
+
     bool m_is_hdr { true };
     bool m_is_bloom { true };
     float m_exposure { 1.0f };
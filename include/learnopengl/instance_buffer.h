@@ -0,0 +1,51 @@
+#ifndef INSTANCE_BUFFER_H
+#define INSTANCE_BUFFER_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// GPU buffer of per-instance model matrices, consumed by Mesh::DrawGeometry
+// through vertex attributes 5-8 (one vec4 column per attribute).
+class InstanceBuffer {
+
+  public:
+    explicit InstanceBuffer(const std::vector<glm::mat4> &models) {
+        glGenBuffers(1, &m_VBO);
+        update(models);
+    }
+
+    InstanceBuffer(const InstanceBuffer &) = delete;
+    InstanceBuffer &operator=(const InstanceBuffer &) = delete;
+
+    ~InstanceBuffer() { glDeleteBuffers(1, &m_VBO); }
+
+    void update(const std::vector<glm::mat4> &models) {
+        glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+        if (models.size() > m_capacity) {
+            glBufferData(
+                GL_ARRAY_BUFFER, models.size() * sizeof(glm::mat4),
+                models.data(), GL_DYNAMIC_DRAW);
+            m_capacity = models.size();
+        } else if (!models.empty()) {
+            glBufferSubData(
+                GL_ARRAY_BUFFER, 0, models.size() * sizeof(glm::mat4),
+                models.data());
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        m_count = models.size();
+    }
+
+    GLuint id() const { return m_VBO; }
+
+    unsigned count() const { return m_count; }
+
+  private:
+    GLuint m_VBO { 0u };
+    unsigned m_count { 0u };
+    std::size_t m_capacity { 0u };
+};
+
+#endif // INSTANCE_BUFFER_H
@@ -0,0 +1,113 @@
+#ifndef INSTANCE_GRID_H
+#define INSTANCE_GRID_H
+
+#include <learnopengl/aabb.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+// Instances of one mesh bucketed by position into square cells of the xz
+// plane, so the instances near a point are found without visiting all of
+// them and a cell whose box is culled skips all of its instances. build()
+// caches every instance's world-space box and the box around each cell's
+// instances; rebuild whenever the instances change.
+class InstanceGrid {
+
+  public:
+    struct Cell {
+        AABB bounds;
+        std::vector<unsigned> instances;
+    };
+
+    explicit InstanceGrid(const float cellSize)
+        : m_cellSize { cellSize } {}
+
+    // buckets the instances placed by `models`, `bounds` being the mesh's
+    // object-space box
+    void build(const std::vector<glm::mat4> &models, const AABB &bounds) {
+        m_positions.clear();
+        m_boxes.clear();
+        m_cells.clear();
+        m_origin = glm::vec2(FLT_MAX);
+        glm::vec2 end(-FLT_MAX);
+        for (const glm::mat4 &model : models) {
+            const glm::vec2 position { model[3].x, model[3].z };
+            m_origin = glm::min(m_origin, position);
+            end = glm::max(end, position);
+            m_positions.emplace_back(model[3]);
+            m_boxes.push_back(bounds.transformed(model));
+        }
+        if (models.empty()) {
+            m_columns = m_rows = 0;
+            return;
+        }
+        m_columns = static_cast<int>((end.x - m_origin.x) / m_cellSize) + 1;
+        m_rows = static_cast<int>((end.y - m_origin.y) / m_cellSize) + 1;
+        m_cells.resize(static_cast<std::size_t>(m_columns) * m_rows);
+        for (unsigned instance = 0; instance < models.size(); instance++) {
+            const glm::vec3 &position = m_positions[instance];
+            Cell &cell = m_cells[cellIndex(position)];
+            cell.instances.push_back(instance);
+            cell.bounds.add(m_boxes[instance]);
+        }
+    }
+
+    // calls visit(instance) for every instance whose position lies within
+    // `radius` of `point`
+    template <typename Visit>
+    void visitNear(
+        const glm::vec3 &point, const float radius, Visit visit) const {
+        if (m_cells.empty()) return;
+        const int x0 = std::max(column(point.x - radius), 0);
+        const int x1 = std::min(column(point.x + radius), m_columns - 1);
+        const int z0 = std::max(row(point.z - radius), 0);
+        const int z1 = std::min(row(point.z + radius), m_rows - 1);
+        for (int z = z0; z <= z1; z++) {
+            for (int x = x0; x <= x1; x++) {
+                const Cell &cell =
+                    m_cells[static_cast<std::size_t>(z) * m_columns + x];
+                for (const unsigned instance : cell.instances) {
+                    if (glm::distance(m_positions[instance], point) < radius)
+                        visit(instance);
+                }
+            }
+        }
+    }
+
+    // world-space box of an instance
+    const AABB &box(const unsigned instance) const {
+        return m_boxes[instance];
+    }
+
+    const std::vector<Cell> &cells() const { return m_cells; }
+
+  private:
+    // cell coordinates, unclamped; positions left of or below the origin
+    // round down to negative ones
+    int column(const float x) const {
+        return static_cast<int>(std::floor((x - m_origin.x) / m_cellSize));
+    }
+
+    int row(const float z) const {
+        return static_cast<int>(std::floor((z - m_origin.y) / m_cellSize));
+    }
+
+    std::size_t cellIndex(const glm::vec3 &position) const {
+        return static_cast<std::size_t>(row(position.z)) * m_columns +
+               column(position.x);
+    }
+
+    float m_cellSize;
+    glm::vec2 m_origin { 0.0f };
+    int m_columns { 0 };
+    int m_rows { 0 };
+    std::vector<glm::vec3> m_positions;
+    std::vector<AABB> m_boxes;
+    std::vector<Cell> m_cells;
+};
+
+#endif // INSTANCE_GRID_H
@@ -0,0 +1,237 @@
+#ifndef LIGHT_MANAGER_H
+#define LIGHT_MANAGER_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/gl43.h>
+#include <learnopengl/magic_light.h>
+#include <learnopengl/shader.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <vector>
+
+// static part of a light, laid out the same in std140 and std430
+// (GpuLightParams in lighting.glsl)
+struct GpuLightParams {
+    glm::vec4 ambient;
+    glm::vec4 diffuse;
+    glm::vec4 specular;
+    glm::vec4 attenuation; // constant, linear, quadratic, angular speed
+};
+
+// Owns the magic lights and their GPU copies. Positions (with the radius in
+// w) and the static parameters live in separate packed arrays: positions
+// are uploaded once per frame in a single call, parameters only after
+// lights were added or removed.
+//
+// With GPU motion on, the position array holds the base positions instead
+// and the shaders evaluate the orbit from the `time` uniform (see
+// light_params.glsl): nothing is done per light per frame, and positions
+// are only resent when lights change.
+//
+// Two GPU copies exist, each uploaded only when its lighting path asks for
+// it: the MagicLights uniform block (the first UNIFORM_LIGHTS lights) and,
+// on GL 4.3, storage buffers holding every light.
+class LightManager {
+
+  public:
+    // size of the arrays in the MagicLights uniform block
+    static const unsigned UNIFORM_LIGHTS = 100;
+    // uniform buffer binding point of the MagicLights block
+    static const GLuint UNIFORM_BINDING = 0;
+    // storage buffer binding points, see clustered_lights.glsl
+    static const GLuint POSITIONS_BINDING = 0;
+    static const GLuint PARAMS_BINDING = 4;
+
+    LightManager() {
+        glGenBuffers(1, &m_uniformBuffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, m_uniformBuffer);
+        glBufferData(
+            GL_UNIFORM_BUFFER,
+            UNIFORM_LIGHTS * (sizeof(glm::vec4) + sizeof(GpuLightParams)),
+            nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, UNIFORM_BINDING, m_uniformBuffer);
+
+        if (gl43::supported()) {
+            glGenBuffers(2, m_storageBuffers);
+            // the bindings survive reallocation, so they are set once
+            glBindBufferBase(
+                GL_SHADER_STORAGE_BUFFER, POSITIONS_BINDING,
+                m_storageBuffers[0]);
+            glBindBufferBase(
+                GL_SHADER_STORAGE_BUFFER, PARAMS_BINDING, m_storageBuffers[1]);
+        }
+    }
+
+    LightManager(const LightManager &) = delete;
+    LightManager &operator=(const LightManager &) = delete;
+
+    ~LightManager() {
+        glDeleteBuffers(1, &m_uniformBuffer);
+        glDeleteBuffers(2, m_storageBuffers);
+    }
+
+    void add(const glm::vec3 &position, const glm::vec3 &color) {
+        m_lights.emplace_back(position, color, m_lights.size());
+        const MagicLight &light = m_lights.back();
+        m_positions.push_back(packedPosition(light));
+        m_params.push_back(
+            GpuLightParams { glm::vec4(light.ambient(), 0.0f),
+                             glm::vec4(light.color(), 0.0f),
+                             glm::vec4(light.color(), 0.0f),
+                             glm::vec4(
+                                 light.attenuation(), light.angularSpeed()) });
+        markDirty(m_lights.size() - 1);
+    }
+
+    // removes the most recently added light
+    void pop() {
+        m_lights.pop_back();
+        m_positions.pop_back();
+        m_params.pop_back();
+        markDirty(m_lights.size());
+    }
+
+    // moves every light and packs the new positions; with GPU motion the
+    // shaders take the time from the FrameConstants block instead
+    void nextFrame(const float currentFrame) {
+        if (m_gpuMotion) return;
+        for (std::size_t i = 0; i < m_lights.size(); i++) {
+            m_lights[i].nextFrame(currentFrame);
+            m_positions[i] = packedPosition(m_lights[i]);
+        }
+        m_uniformDirty.positions = 0;
+        m_storageDirty.positions = 0;
+    }
+
+    bool gpuMotion() const { return m_gpuMotion; }
+
+    void setGpuMotion(const bool enabled) {
+        if (enabled == m_gpuMotion) return;
+        m_gpuMotion = enabled;
+        for (std::size_t i = 0; i < m_lights.size(); i++)
+            m_positions[i] = packedPosition(m_lights[i]);
+        m_uniformDirty.positions = 0;
+        m_storageDirty.positions = 0;
+    }
+
+    // center and radius of a sphere holding the light's influence this
+    // frame. With GPU motion the CPU does not know the current position, so
+    // the sphere covers the whole orbit.
+    void influence(
+        const MagicLight &light, glm::vec3 &center, float &radius) const {
+        if (m_gpuMotion) {
+            center = light.orbitCenter();
+            radius = light.radius() + MagicLight::ORBIT_RADIUS;
+        } else {
+            center = light.position();
+            radius = light.radius();
+        }
+    }
+
+    // uploads the first UNIFORM_LIGHTS lights to the MagicLights block
+    void uploadUniformBlock() {
+        const std::size_t count = std::min<std::size_t>(size(), UNIFORM_LIGHTS);
+        upload(
+            GL_UNIFORM_BUFFER, m_uniformBuffer, m_uniformBuffer,
+            UNIFORM_LIGHTS * sizeof(glm::vec4), count, m_uniformDirty);
+        m_uniformDirty = DirtyRange { count, count };
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    // uploads every light to the storage buffers (GL 4.3 only)
+    void uploadStorage() {
+        if (m_lights.empty()) return;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_storageBuffers[0]);
+        if (size() > m_storageCapacity) {
+            // grow both buffers; every light has to be resent
+            m_storageCapacity = std::max(size(), 2 * m_storageCapacity);
+            glBufferData(
+                GL_SHADER_STORAGE_BUFFER,
+                m_storageCapacity * sizeof(glm::vec4), nullptr,
+                GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_storageBuffers[1]);
+            glBufferData(
+                GL_SHADER_STORAGE_BUFFER,
+                m_storageCapacity * sizeof(GpuLightParams), nullptr,
+                GL_DYNAMIC_DRAW);
+            m_storageDirty = DirtyRange {};
+        }
+        upload(
+            GL_SHADER_STORAGE_BUFFER, m_storageBuffers[0], m_storageBuffers[1],
+            0, size(), m_storageDirty);
+        m_storageDirty = DirtyRange { size(), size() };
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    // binds the MagicLights block of a Shader or of all ShaderVariants to
+    // the light uniform buffer
+    template <typename Program> void bindUniformBlock(Program &program) const {
+        program.uniformBlock("MagicLights", UNIFORM_BINDING);
+    }
+
+    const std::vector<MagicLight> &lights() const { return m_lights; }
+
+    std::size_t size() const { return m_lights.size(); }
+
+  private:
+    // index of the first light whose position and parameters a GPU copy is
+    // missing
+    struct DirtyRange {
+        std::size_t positions { 0u };
+        std::size_t params { 0u };
+    };
+
+    glm::vec4 packedPosition(const MagicLight &light) const {
+        return glm::vec4(
+            m_gpuMotion ? light.basePosition() : light.position(),
+            light.radius());
+    }
+
+    // lights from the given one on have to be resent
+    void markDirty(const std::size_t first) {
+        for (DirtyRange *dirty : { &m_uniformDirty, &m_storageDirty }) {
+            dirty->positions = std::min(dirty->positions, first);
+            dirty->params = std::min(dirty->params, first);
+        }
+    }
+
+    // sends the dirty part of the first `count` lights: positions to the
+    // start of `positions`, parameters from `paramsOffset` on in `params`
+    void upload(
+        const GLenum target, const GLuint positions, const GLuint params,
+        const GLintptr paramsOffset, const std::size_t count,
+        const DirtyRange &dirty) const {
+        if (dirty.positions < count) {
+            glBindBuffer(target, positions);
+            glBufferSubData(
+                target, dirty.positions * sizeof(glm::vec4),
+                (count - dirty.positions) * sizeof(glm::vec4),
+                m_positions.data() + dirty.positions);
+        }
+        if (dirty.params < count) {
+            glBindBuffer(target, params);
+            glBufferSubData(
+                target, paramsOffset + dirty.params * sizeof(GpuLightParams),
+                (count - dirty.params) * sizeof(GpuLightParams),
+                m_params.data() + dirty.params);
+        }
+    }
+
+    std::vector<MagicLight> m_lights;
+    std::vector<glm::vec4> m_positions;
+    std::vector<GpuLightParams> m_params;
+
+    GLuint m_uniformBuffer { 0u };
+    GLuint m_storageBuffers[2] { 0u, 0u };
+    std::size_t m_storageCapacity { 0u };
+    DirtyRange m_uniformDirty;
+    DirtyRange m_storageDirty;
+
+    bool m_gpuMotion { false };
+};
+
+#endif // LIGHT_MANAGER_H
@@ -0,0 +1,170 @@
+#ifndef LIGHT_VOLUMES_H
+#define LIGHT_VOLUMES_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/gl_state.h>
+#include <learnopengl/shader.h>
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <vector>
+
+// Point lights shaded by rasterizing their spheres of influence instead of
+// looping over them in the full-screen lighting pass, so a light costs only
+// the pixels it covers. Each light is a low-poly sphere drawn twice into
+// the lit framebuffer, which holds a copy of the G-buffer's depth and
+// stencil:
+//
+// 1. stencil pass, no color or depth writes and no culling: back faces
+//    behind the scene increment the stencil and front faces behind it
+//    decrement it, so only pixels whose geometry lies inside the sphere
+//    end up non-zero;
+// 2. lighting pass, back faces without depth test: light_volume.frag adds
+//    the light where the stencil is non-zero and zeroes it again, which
+//    leaves the stencil clear for the next light.
+//
+// Depth clamping keeps spheres crossing the near or far plane closed. The
+// stencil has to be zero everywhere before the first light.
+class LightVolumes {
+
+  public:
+    // tessellation of the sphere
+    static const unsigned SEGMENTS = 16;
+    static const unsigned RINGS = 8;
+
+    // `stencilPass` and `lightingPass` are built from light_volume.vert
+    LightVolumes(Shader &stencilPass, Shader &lightingPass)
+        : m_stencilPass { stencilPass }
+        , m_lightingPass { lightingPass }
+        , m_stencilLight { stencilPass.handle<int>("light") }
+        , m_lightingLight { lightingPass.handle<int>("light") }
+        , m_stencilMotion { stencilPass.handle<bool>("gpuLightMotion") }
+        , m_lightingMotion { lightingPass.handle<bool>("gpuLightMotion") } {
+        // the faces' midpoints of a unit sphere sit inside it; scaled so
+        // the polygons enclose it instead
+        const float pi = std::acos(-1.0f);
+        const float scale =
+            1.0f / (std::cos(pi / SEGMENTS) * std::cos(pi / (2 * RINGS)));
+        std::vector<glm::vec3> vertices;
+        for (unsigned ring = 0; ring <= RINGS; ring++) {
+            const float polar = pi * ring / RINGS;
+            for (unsigned segment = 0; segment < SEGMENTS; segment++) {
+                const float azimuth = 2.0f * pi * segment / SEGMENTS;
+                vertices.push_back(
+                    scale * glm::vec3(
+                                std::sin(polar) * std::cos(azimuth),
+                                std::cos(polar),
+                                std::sin(polar) * std::sin(azimuth)));
+            }
+        }
+        // counter-clockwise seen from outside
+        std::vector<unsigned int> indices;
+        for (unsigned ring = 0; ring < RINGS; ring++) {
+            for (unsigned segment = 0; segment < SEGMENTS; segment++) {
+                const unsigned next = (segment + 1) % SEGMENTS;
+                const unsigned a = ring * SEGMENTS + segment;
+                const unsigned b = ring * SEGMENTS + next;
+                const unsigned c = (ring + 1) * SEGMENTS + segment;
+                const unsigned d = (ring + 1) * SEGMENTS + next;
+                indices.insert(indices.end(), { a, b, c, b, d, c });
+            }
+        }
+        m_indexCount = indices.size();
+
+        glGenVertexArrays(1, &m_vao);
+        glGenBuffers(2, m_buffers);
+        GLState::get().bindVertexArray(m_vao);
+        glBindBuffer(GL_ARRAY_BUFFER, m_buffers[0]);
+        glBufferData(
+            GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3),
+            vertices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_buffers[1]);
+        glBufferData(
+            GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
+            indices.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(
+            0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void *) nullptr);
+        GLState::get().bindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    LightVolumes(const LightVolumes &) = delete;
+    LightVolumes &operator=(const LightVolumes &) = delete;
+
+    ~LightVolumes() {
+        GLState::get().deleteVertexArrays(1, &m_vao);
+        glDeleteBuffers(2, m_buffers);
+    }
+
+    Shader &stencilPass() { return m_stencilPass; }
+
+    Shader &lightingPass() { return m_lightingPass; }
+
+    // whether the light positions are orbits evaluated in the shaders, see
+    // LightManager::gpuMotion()
+    void setGpuMotion(const bool enabled) {
+        m_stencilMotion.set(enabled);
+        m_lightingMotion.set(enabled);
+    }
+
+    // shades the lights with the given indices into the MagicLights block.
+    // Expects the G-buffer textures bound, stencil testing enabled and the
+    // depth test on; restores the depth, cull and color state of the scene.
+    void draw(const std::vector<unsigned> &lights) {
+        if (lights.empty()) return;
+        GLState::get().bindVertexArray(m_vao);
+        glEnable(GL_DEPTH_CLAMP);
+        glDepthMask(GL_FALSE);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+        glStencilOpSeparate(GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP);
+        glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP);
+        for (const unsigned light : lights) {
+            m_stencilPass.use();
+            m_stencilLight.set(static_cast<int>(light));
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            glDisable(GL_CULL_FACE);
+            glEnable(GL_DEPTH_TEST);
+            glStencilFunc(GL_ALWAYS, 0, 0xFF);
+            glDrawElements(
+                GL_TRIANGLES, m_indexCount, GL_UNSIGNED_INT, nullptr);
+
+            m_lightingPass.use();
+            m_lightingLight.set(static_cast<int>(light));
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            glEnable(GL_CULL_FACE);
+            glCullFace(GL_FRONT);
+            glDisable(GL_DEPTH_TEST);
+            // only back faces pass the cull, so the zero op is the same
+            // for both sides
+            glStencilFunc(GL_NOTEQUAL, 0, 0xFF);
+            glStencilOpSeparate(GL_BACK, GL_KEEP, GL_KEEP, GL_ZERO);
+            glDrawElements(
+                GL_TRIANGLES, m_indexCount, GL_UNSIGNED_INT, nullptr);
+            glStencilOpSeparate(GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP);
+        }
+        glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+        glCullFace(GL_BACK);
+        glEnable(GL_DEPTH_TEST);
+        glDisable(GL_BLEND);
+        glDepthMask(GL_TRUE);
+        glDisable(GL_DEPTH_CLAMP);
+    }
+
+  private:
+    Shader &m_stencilPass;
+    Shader &m_lightingPass;
+    Uniform<int> m_stencilLight;
+    Uniform<int> m_lightingLight;
+    Uniform<bool> m_stencilMotion;
+    Uniform<bool> m_lightingMotion;
+    GLuint m_vao { 0u };
+    // vertices, indices
+    GLuint m_buffers[2] {};
+    GLsizei m_indexCount { 0 };
+};
+
+#endif // LIGHT_VOLUMES_H
@@ -1,69 +1,79 @@
 #ifndef MAGIC_LIGHT_H
 #define MAGIC_LIGHT_H
 
-#include <glad/glad.h>
-
-#include <learnopengl/shader.h>
-
 #include <glm/glm.hpp>
 
 #include <cmath>
 #include <cstdlib>
-#include <iostream>
 
 class MagicLight {
 
   public:
+    // lights circle ORBIT_RADIUS above and around their base position
+    static constexpr float ORBIT_RADIUS = 4.0f;
+
     MagicLight(
-        const glm::vec3 &position, const glm::vec3 &color, const unsigned index,
-        Shader &shader)
+        const glm::vec3 &position, const glm::vec3 &color, const unsigned index)
         : m_position { position }
         , m_color { color }
         , m_index { index }
-        , m_shader { shader }
         , m_speed { random() }
         , m_direction { direction() } {
-        shader.uniform(
-            "magicLights[" + std::to_string(index) + "].ambient", 0.1f * color);
-        shader.uniform(
-            "magicLights[" + std::to_string(index) + "].diffuse", color);
-        shader.uniform(
-            "magicLights[" + std::to_string(index) + "].specular", color);
         // update attenuation parameters and calculate radius
         const float constant = 1.0f;
         const float linear = 0.28f;
         const float quadratic = 0.14f;
-        shader.uniform(
-            "magicLights[" + std::to_string(index) + "].constant", linear);
-        shader.uniform(
-            "magicLights[" + std::to_string(index) + "].linear", linear);
-        shader.uniform(
-            "magicLights[" + std::to_string(index) + "].quadratic", quadratic);
+        // the shader has always been given `linear` as the constant term
+        m_attenuation = glm::vec3(linear, linear, quadratic);
         // then calculate radius of light volume/sphere
         const float maxBrightness =
             std::fmaxf(std::fmaxf(color.r, color.g), color.b);
-        float radius =
+        m_radius =
             (-linear +
              std::sqrt(
                  linear * linear -
                  4 * quadratic *
                      (constant - (65536.0f / 128.0f) * maxBrightness))) /
             (2.0f * quadratic);
-        shader.uniform(
-            "magicLights[" + std::to_string(index) + "].radius", radius);
     }
 
+    // same orbit as lightPosition() in light_params.glsl
     void nextFrame(const float currentFrame) {
-        auto nextPosition =
-            m_position + glm::vec3(
-                             4.0 * cos(m_direction * m_speed * currentFrame),
-                             4.0f,
-                             4.0 * sin(m_direction * m_speed * currentFrame));
-        m_shader.uniform(
-            "magicLights[" + std::to_string(m_index) + "].position",
-            nextPosition);
+        const float angle = angularSpeed() * currentFrame;
+        m_currentPosition =
+            orbitCenter() + glm::vec3(
+                                ORBIT_RADIUS * std::cos(angle), 0.0f,
+                                ORBIT_RADIUS * std::sin(angle));
+    }
+
+    // position set by the last nextFrame()
+    const glm::vec3 &position() const { return m_currentPosition; }
+
+    const glm::vec3 &basePosition() const { return m_position; }
+
+    glm::vec3 orbitCenter() const {
+        const float height = ORBIT_RADIUS;
+        return m_position + glm::vec3(0.0f, height, 0.0f);
     }
 
+    // signed orbit speed in radians per second
+    float angularSpeed() const {
+        return static_cast<float>(m_direction * m_speed);
+    }
+
+    // distance at which the light's contribution becomes negligible
+    float radius() const { return m_radius; }
+
+    unsigned index() const { return m_index; }
+
+    glm::vec3 ambient() const { return 0.1f * m_color; }
+
+    // diffuse and specular color
+    const glm::vec3 &color() const { return m_color; }
+
+    // constant, linear and quadratic attenuation terms
+    const glm::vec3 &attenuation() const { return m_attenuation; }
+
   private:
     double random() const {
         double min { 1.0 };
@@ -76,9 +86,11 @@ class MagicLight {
     int direction() { return (std::rand() % 2) * 2 - 1; }
 
     glm::vec3 m_position;
+    glm::vec3 m_currentPosition { m_position };
     glm::vec3 m_color;
+    glm::vec3 m_attenuation;
+    float m_radius {};
     const unsigned m_index;
-    Shader &m_shader;
     double m_speed;
     int m_direction;
 };
@@ -6,66 +6,148 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <learnopengl/aabb.h>
+#include <learnopengl/geometry_pool.h>
+#include <learnopengl/instance_buffer.h>
 #include <learnopengl/shader.h>
 
 #include <string>
 #include <vector>
 using namespace std;
 
-struct Vertex {
-    // position
-    glm::vec3 Position;
-    // normal
-    glm::vec3 Normal;
-    // texCoords
-    glm::vec2 TexCoords;
-    // tangent
-    glm::vec3 Tangent;
-    // bitangent
-    glm::vec3 Bitangent;
-};
-
 struct Texture {
     unsigned int id;
     string type;
     string path;
+    // has texels the geometry pass discards (alpha below 0.1)
+    bool cutout { false };
 };
 
+// which meshes of a model a draw covers; opaque meshes are drawn before the
+// alpha-tested ones with a shader that never discards, so they keep early
+// depth testing
+enum class DrawBucket { All, Opaque, AlphaTested };
+
 class Mesh {
   public:
     // mesh Data
     vector<Vertex> vertices;
     vector<unsigned int> indices;
     vector<Texture> textures;
-
-    unsigned int VAO;
-    std::string glslIdentifierPrefix;
+    // object-space bounds of the vertices
+    AABB bounds;
+    // the material needs the discarding (alpha-tested) geometry pass
+    bool alphaTested;
+    // where the vertices and indices live in the GeometryPool
+    GeometryPool::Range range;
     // constructor
     Mesh(
         vector<Vertex> vertices, vector<unsigned int> indices,
-        vector<Texture> textures) {
+        vector<Texture> textures, const AABB &bounds,
+        const bool alphaTested = false) {
         this->vertices = vertices;
         this->indices = indices;
         this->textures = textures;
+        this->bounds = bounds;
+        this->alphaTested = alphaTested;
+
+        // now that we have all the required data, copy it to the shared
+        // vertex and index buffers
+        range = GeometryPool::get().add(vertices, indices);
+    }
+
+    // sets the prefix of the sampler names (e.g. "material.") and drops the
+    // sampler locations resolved with the previous one
+    void SetShaderTextureNamePrefix(const std::string &prefix) {
+        glslIdentifierPrefix = prefix;
+        samplerBindings.clear();
+    }
 
-        // now that we have all the required data, set the vertex buffers and
-        // its attribute pointers.
-        setupMesh();
+    bool inBucket(const DrawBucket bucket) const {
+        return bucket == DrawBucket::All ||
+               alphaTested == (bucket == DrawBucket::AlphaTested);
     }
 
-    // render the mesh
-    void Draw(Shader &shader) {
-        // bind appropriate textures
+    // makes the shader current, binds the mesh's textures and points the
+    // shader's samplers at them
+    void BindMaterial(Shader &shader) {
+        shader.use();
+        const SamplerBindings &bindings = samplerBindingsFor(shader);
+        for (unsigned int i = 0; i < textures.size(); i++) {
+            // set the sampler to the correct texture unit
+            glUniform1i(bindings.locations[i], i);
+            // and bind the texture to it, unless it already is
+            GLState::get().bindTexture(i, GL_TEXTURE_2D, textures[i].id);
+        }
+    }
+
+    // true if both meshes bind the same textures
+    bool SameMaterial(const Mesh &other) const {
+        if (textures.size() != other.textures.size()) return false;
+        for (unsigned int i = 0; i < textures.size(); i++) {
+            if (textures[i].id != other.textures[i].id) return false;
+        }
+        return true;
+    }
+
+    // 24-bit hash of the texture set, equal for meshes with SameMaterial()
+    unsigned int MaterialKey() const {
+        unsigned int key = 2166136261u;
+        for (const Texture &texture : textures)
+            key = (key ^ texture.id) * 16777619u;
+        return (key ^ (key >> 24)) & 0xFFFFFFu;
+    }
+
+    // issues the draw call with the material already bound. For the depth
+    // pre-pass (positionsOnly), opaque meshes read the position-only stream;
+    // alpha-tested ones still need their texture coordinates and diffuse
+    // texture for the alpha test. Draws one copy per model matrix in
+    // `instances` if given.
+    void DrawGeometry(
+        const bool positionsOnly, const InstanceBuffer *instances) {
+        const bool depthStream = positionsOnly && !alphaTested;
+        // every mesh shares the pool's VAOs, GLState skips rebinding them
+        GeometryPool &pool = GeometryPool::get();
+        if (!instances) {
+            pool.bind(depthStream);
+            glDrawElementsBaseVertex(
+                GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT,
+                range.indexOffset(), range.baseVertex);
+            return;
+        }
+        pool.bind(depthStream, instances->id());
+        glDrawElementsInstancedBaseVertex(
+            GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT,
+            range.indexOffset(), instances->count(), range.baseVertex);
+    }
+
+  private:
+    // sampler uniform locations of this mesh's textures in one program,
+    // indexed like textures
+    struct SamplerBindings {
+        unsigned int program;
+        vector<GLint> locations;
+    };
+
+    std::string glslIdentifierPrefix;
+    vector<SamplerBindings> samplerBindings;
+
+    // returns the sampler locations for the shader, resolving them on the
+    // first draw with it so the draw path doesn't build uniform names.
+    const SamplerBindings &samplerBindingsFor(Shader &shader) {
+        for (const auto &bindings : samplerBindings) {
+            if (bindings.program == shader.ID) return bindings;
+        }
+
+        SamplerBindings bindings { shader.ID, {} };
         unsigned int diffuseNr = 1;
         unsigned int specularNr = 1;
         unsigned int normalNr = 1;
         unsigned int heightNr = 1;
-        for (unsigned int i = 0; i < textures.size(); i++) {
-            glActiveTexture(
-                GL_TEXTURE0 + i); // active proper texture unit before binding
+        for (const auto &texture : textures) {
             // retrieve texture number (the N in diffuse_textureN)
             string number;
-            string name = textures[i].type;
+            const string &name = texture.type;
             if (name == "texture_diffuse")
                 number = std::to_string(diffuseNr++);
             else if (name == "texture_specular")
@@ -77,80 +159,11 @@ class Mesh {
             else if (name == "texture_height")
                 number = std::to_string(
                     heightNr++); // transfer unsigned int to stream
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(
-                glGetUniformLocation(
-                    shader.ID, (glslIdentifierPrefix + name + number).c_str()),
-                i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            bindings.locations.push_back(
+                shader.location(glslIdentifierPrefix + name + number));
         }
-
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, nullptr);
-        glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once
-        // configured.
-        glActiveTexture(GL_TEXTURE0);
-    }
-
-  private:
-    // render data
-    unsigned int VBO, EBO;
-
-    // initializes all the buffer objects/arrays
-    void setupMesh() {
-        // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
-
-        glBindVertexArray(VAO);
-        // load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        // A great thing about structs is that their memory layout is sequential
-        // for all its items. The effect is that we can simply pass a pointer to
-        // the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(
-            GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0],
-            GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(
-            GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
-            &indices[0], GL_STATIC_DRAW);
-
-        // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(
-            0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *) nullptr);
-        // vertex normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(
-            1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-            (void *) offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(
-            2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-            (void *) offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(
-            3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-            (void *) offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(
-            4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-            (void *) offsetof(Vertex, Bitangent));
-
-        glBindVertexArray(0);
+        samplerBindings.push_back(bindings);
+        return samplerBindings.back();
     }
 };
 #endif
\ No newline at end of file
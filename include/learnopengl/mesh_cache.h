@@ -0,0 +1,296 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <learnopengl/mesh.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Binary "cooked" copy of an imported model, written next to the source file
+// after the first Assimp import and memory-mapped on later runs.
+//
+// The source file is keyed by a hash of its contents. The files the import
+// also read (material libraries, and the textures the alpha-tested flags
+// were derived from) are listed with their size and modification time; the
+// cache is stale as soon as one of them differs.
+//
+// Layout (native endianness, every section aligned to 4 bytes):
+//   CookedHeader
+//   per dependency: its path as (uint32 length, chars), CookedStamp
+//   per mesh: CookedMeshHeader, then per texture its type and path as
+//             (uint32 length, chars) pairs
+//   per mesh: vertices (Vertex[vertexCount]), indices (uint32[indexCount])
+struct CookedHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t importFlags;
+    uint32_t meshCount;
+    uint32_t dependencyCount;
+    uint64_t sourceHash;
+};
+
+// size and modification time of a dependency, zero if it is missing
+struct CookedStamp {
+    uint64_t size;
+    uint64_t modified;
+
+    bool operator==(const CookedStamp &other) const {
+        return size == other.size && modified == other.modified;
+    }
+};
+
+struct CookedMeshHeader {
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t textureCount;
+    uint32_t flags;
+    float boundsMin[3];
+    float boundsMax[3];
+};
+
+// CookedMeshHeader::flags
+enum CookedMeshFlags : uint32_t { COOKED_MESH_ALPHA_TESTED = 1u << 0 };
+
+struct CookedTexture {
+    string type;
+    string path;
+};
+
+// view of one mesh inside the mapped cache file
+struct CookedMesh {
+    const Vertex *vertices;
+    uint32_t vertexCount;
+    const unsigned int *indices;
+    uint32_t indexCount;
+    vector<CookedTexture> textures;
+    AABB bounds;
+    bool alphaTested;
+};
+
+class MeshCache {
+
+  public:
+    // bump whenever the layout above or the Vertex struct changes
+    static const uint32_t VERSION = 4;
+
+    MeshCache() = default;
+
+    MeshCache(const MeshCache &) = delete;
+    MeshCache &operator=(const MeshCache &) = delete;
+
+    ~MeshCache() { unmap(); }
+
+    // maps the cache file and validates it against the source hash, import
+    // flags and dependencies; returns false when the cache is missing,
+    // stale or malformed.
+    bool open(
+        const string &cachePath, const uint64_t sourceHash,
+        const uint32_t importFlags) {
+        unmap();
+        if (!map(cachePath)) return false;
+
+        const char *cursor = m_data;
+        const char *end = m_data + m_size;
+        CookedHeader header {};
+        if (!read(cursor, end, header) ||
+            std::memcmp(header.magic, magic(), sizeof(header.magic)) != 0 ||
+            header.version != VERSION || header.importFlags != importFlags ||
+            header.sourceHash != sourceHash) {
+            unmap();
+            return false;
+        }
+        for (uint32_t i = 0; i < header.dependencyCount; i++) {
+            string path;
+            CookedStamp stamp {};
+            if (!readString(cursor, end, path) || !read(cursor, end, stamp) ||
+                !(stamp == fileStamp(path)))
+                return fail();
+        }
+
+        vector<CookedMeshHeader> meshHeaders(header.meshCount);
+        m_meshes.resize(header.meshCount);
+        for (uint32_t i = 0; i < header.meshCount; i++) {
+            if (!read(cursor, end, meshHeaders[i])) return fail();
+            m_meshes[i].alphaTested =
+                meshHeaders[i].flags & COOKED_MESH_ALPHA_TESTED;
+            AABB &bounds = m_meshes[i].bounds;
+            for (int axis = 0; axis < 3; axis++) {
+                bounds.min[axis] = meshHeaders[i].boundsMin[axis];
+                bounds.max[axis] = meshHeaders[i].boundsMax[axis];
+            }
+            for (uint32_t j = 0; j < meshHeaders[i].textureCount; j++) {
+                CookedTexture texture;
+                if (!readString(cursor, end, texture.type) ||
+                    !readString(cursor, end, texture.path))
+                    return fail();
+                m_meshes[i].textures.push_back(texture);
+            }
+        }
+        for (uint32_t i = 0; i < header.meshCount; i++) {
+            CookedMesh &mesh = m_meshes[i];
+            mesh.vertexCount = meshHeaders[i].vertexCount;
+            mesh.indexCount = meshHeaders[i].indexCount;
+            const auto vertexBytes = mesh.vertexCount * sizeof(Vertex);
+            const auto indexBytes = mesh.indexCount * sizeof(unsigned int);
+            if (static_cast<size_t>(end - cursor) < vertexBytes + indexBytes)
+                return fail();
+            mesh.vertices = reinterpret_cast<const Vertex *>(cursor);
+            cursor += vertexBytes;
+            mesh.indices = reinterpret_cast<const unsigned int *>(cursor);
+            cursor += indexBytes;
+        }
+        return true;
+    }
+
+    const vector<CookedMesh> &meshes() const { return m_meshes; }
+
+    // `dependencies` are the other files the import read, see above
+    static bool write(
+        const string &cachePath, const uint64_t sourceHash,
+        const uint32_t importFlags, const vector<Mesh> &meshes,
+        const vector<string> &dependencies) {
+        std::ofstream out(cachePath, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cerr << "MeshCache::Failed to write: " << cachePath
+                      << std::endl;
+            return false;
+        }
+
+        CookedHeader header {};
+        std::memcpy(header.magic, magic(), sizeof(header.magic));
+        header.version = VERSION;
+        header.importFlags = importFlags;
+        header.meshCount = meshes.size();
+        header.dependencyCount = dependencies.size();
+        header.sourceHash = sourceHash;
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        for (const string &dependency : dependencies) {
+            const CookedStamp stamp = fileStamp(dependency);
+            writeString(out, dependency);
+            out.write(reinterpret_cast<const char *>(&stamp), sizeof(stamp));
+        }
+
+        for (const Mesh &mesh : meshes) {
+            CookedMeshHeader meshHeader {};
+            meshHeader.vertexCount = mesh.vertices.size();
+            meshHeader.indexCount = mesh.indices.size();
+            meshHeader.textureCount = mesh.textures.size();
+            if (mesh.alphaTested) meshHeader.flags |= COOKED_MESH_ALPHA_TESTED;
+            for (int axis = 0; axis < 3; axis++) {
+                meshHeader.boundsMin[axis] = mesh.bounds.min[axis];
+                meshHeader.boundsMax[axis] = mesh.bounds.max[axis];
+            }
+            out.write(
+                reinterpret_cast<const char *>(&meshHeader),
+                sizeof(meshHeader));
+            for (const Texture &texture : mesh.textures) {
+                writeString(out, texture.type);
+                writeString(out, texture.path);
+            }
+        }
+        for (const Mesh &mesh : meshes) {
+            out.write(
+                reinterpret_cast<const char *>(mesh.vertices.data()),
+                mesh.vertices.size() * sizeof(Vertex));
+            out.write(
+                reinterpret_cast<const char *>(mesh.indices.data()),
+                mesh.indices.size() * sizeof(unsigned int));
+        }
+        return static_cast<bool>(out);
+    }
+
+    // 64-bit FNV-1a of the file contents, 0 if the file can't be read
+    static uint64_t hashFile(const string &path) {
+        MeshCache source;
+        if (!source.map(path)) return 0;
+
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < source.m_size; i++) {
+            hash ^= static_cast<unsigned char>(source.m_data[i]);
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    static CookedStamp fileStamp(const string &path) {
+        struct stat info {};
+        if (stat(path.c_str(), &info) != 0) return CookedStamp {};
+        return CookedStamp { static_cast<uint64_t>(info.st_size),
+                             static_cast<uint64_t>(info.st_mtime) };
+    }
+
+  private:
+    static const char *magic() { return "MDLC"; }
+
+    bool map(const string &path) {
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+
+        struct stat info {};
+        if (fstat(fd, &info) != 0 || info.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        void *data =
+            mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED) return false;
+
+        m_data = static_cast<const char *>(data);
+        m_size = info.st_size;
+        return true;
+    }
+
+    void unmap() {
+        if (m_data) munmap(const_cast<char *>(m_data), m_size);
+        m_data = nullptr;
+        m_size = 0;
+        m_meshes.clear();
+    }
+
+    bool fail() {
+        unmap();
+        return false;
+    }
+
+    template <typename T>
+    static bool read(const char *&cursor, const char *end, T &value) {
+        if (static_cast<size_t>(end - cursor) < sizeof(T)) return false;
+        std::memcpy(&value, cursor, sizeof(T));
+        cursor += sizeof(T);
+        return true;
+    }
+
+    static bool
+    readString(const char *&cursor, const char *end, string &value) {
+        uint32_t length;
+        if (!read(cursor, end, length)) return false;
+        const auto padded = (length + 3u) & ~3u;
+        if (static_cast<size_t>(end - cursor) < padded) return false;
+        value.assign(cursor, length);
+        cursor += padded;
+        return true;
+    }
+
+    static void writeString(std::ofstream &out, const string &value) {
+        const uint32_t length = value.size();
+        const char padding[4] {};
+        out.write(reinterpret_cast<const char *>(&length), sizeof(length));
+        out.write(value.data(), length);
+        out.write(padding, ((length + 3u) & ~3u) - length);
+    }
+
+    const char *m_data { nullptr };
+    size_t m_size { 0u };
+    vector<CookedMesh> m_meshes;
+};
+
+#endif // MESH_CACHE_H
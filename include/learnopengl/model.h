@@ -10,7 +10,11 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <stb_image.h>
 
+#include <learnopengl/frustum.h>
+#include <learnopengl/instance_buffer.h>
 #include <learnopengl/mesh.h>
+#include <learnopengl/mesh_cache.h>
+#include <learnopengl/render_queue.h>
 #include <learnopengl/shader.h>
 
 #include <fstream>
@@ -21,8 +25,9 @@
 #include <vector>
 using namespace std;
 
-unsigned int
-TextureFromFile(const char *path, const string &directory, bool gamma = false);
+unsigned int TextureFromFile(
+    const char *path, const string &directory, bool gamma = false,
+    bool *cutout = nullptr);
 
 class Model {
   public:
@@ -40,27 +45,78 @@ class Model {
         loadModel(path);
     }
 
-    // draws the model, and thus all its meshes
-    void Draw(Shader &shader) {
-        for (auto &meshe : meshes)
-            meshe.Draw(shader);
+    // queues the meshes of the bucket whose bounds, placed by the model
+    // matrix, intersect the frustum; the queue sets the "model" uniform
+    void Submit(
+        RenderQueue &queue, const RenderPass pass, Shader &shader,
+        Frustum &frustum, const glm::mat4 &model,
+        const DrawBucket bucket = DrawBucket::All) {
+        unsigned index = ~0u;
+        for (auto &meshe : meshes) {
+            if (!meshe.inBucket(bucket)) continue;
+            const AABB bounds = meshe.bounds.transformed(model);
+            if (frustum.cull(bounds, meshe.range.indexCount / 3)) continue;
+            if (index == ~0u) index = queue.addModel(model);
+            queue.submit(pass, shader, meshe, index);
+        }
+    }
+
+    // object-space bounds of all meshes
+    const AABB &bounds() const { return m_bounds; }
+
+    unsigned long triangles() const {
+        unsigned long count = 0ul;
+        for (const Mesh &mesh : meshes)
+            count += mesh.range.indexCount / 3;
+        return count;
+    }
+
+    // queues every mesh of the bucket once per instance of an
+    // InstanceBuffer or of the survivors of GpuCulling
+    template <typename Instances>
+    void SubmitInstanced(
+        RenderQueue &queue, const RenderPass pass, Shader &shader,
+        const Instances &instances,
+        const DrawBucket bucket = DrawBucket::All) {
+        for (auto &meshe : meshes) {
+            if (meshe.inBucket(bucket))
+                queue.submit(pass, shader, meshe, instances);
+        }
     }
 
     void SetShaderTextureNamePrefix(std::string prefix) {
         for (Mesh &mesh : meshes) {
-            mesh.glslIdentifierPrefix = prefix;
+            mesh.SetShaderTextureNamePrefix(prefix);
         }
     }
 
   private:
+    AABB m_bounds;
+
     // loads a model with supported ASSIMP extensions from file and stores the
     // resulting meshes in the meshes vector.
     void loadModel(string const &path) {
+        loadMeshes(path);
+        for (const Mesh &mesh : meshes) {
+            m_bounds.add(mesh.bounds);
+        }
+    }
+
+    void loadMeshes(string const &path) {
+        const unsigned int importFlags =
+            aiProcess_Triangulate | aiProcess_GenSmoothNormals |
+            aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+        // retrieve the directory path of the filepath
+        directory = path.substr(0, path.find_last_of('/'));
+
+        // skip ASSIMP entirely when a cooked copy of this exact file exists
+        const string cachePath = path + ".cooked";
+        const uint64_t sourceHash = MeshCache::hashFile(path);
+        if (loadCooked(cachePath, sourceHash, importFlags)) return;
+
         // read file via ASSIMP
         Assimp::Importer importer;
-        const aiScene *scene = importer.ReadFile(
-            path, aiProcess_Triangulate | aiProcess_GenSmoothNormals |
-                      aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        const aiScene *scene = importer.ReadFile(path, importFlags);
         // check for errors
         if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE ||
             !scene->mRootNode) // if is Not Zero
@@ -68,11 +124,56 @@ class Model {
             cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
             return;
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
 
         // process ASSIMP's root node recursively
         processNode(scene->mRootNode, scene);
+
+        MeshCache::write(
+            cachePath, sourceHash, importFlags, meshes, dependencies(path));
+    }
+
+    // files besides the OBJ that the import read: its material libraries
+    // and every texture, whose alpha decides which meshes are alpha-tested
+    vector<string> dependencies(const string &path) const {
+        vector<string> files;
+        std::ifstream obj(path);
+        string line;
+        while (std::getline(obj, line)) {
+            std::istringstream words(line);
+            string keyword;
+            words >> keyword;
+            if (keyword != "mtllib") continue;
+            string library;
+            while (words >> library)
+                files.push_back(directory + '/' + library);
+        }
+        for (const Texture &texture : textures_loaded)
+            files.push_back(directory + '/' + texture.path);
+        return files;
+    }
+
+    // builds the meshes straight from a memory-mapped cooked file; returns
+    // false if the cache is missing or doesn't match the source file.
+    bool loadCooked(
+        const string &cachePath, const uint64_t sourceHash,
+        const unsigned int importFlags) {
+        MeshCache cache;
+        if (!cache.open(cachePath, sourceHash, importFlags)) return false;
+
+        for (const CookedMesh &cooked : cache.meshes()) {
+            vector<Texture> textures;
+            for (const CookedTexture &texture : cooked.textures) {
+                textures.push_back(
+                    loadTexture(texture.path.c_str(), texture.type));
+            }
+            meshes.emplace_back(
+                vector<Vertex>(
+                    cooked.vertices, cooked.vertices + cooked.vertexCount),
+                vector<unsigned int>(
+                    cooked.indices, cooked.indices + cooked.indexCount),
+                textures, cooked.bounds, cooked.alphaTested);
+        }
+        return true;
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh
@@ -99,6 +200,7 @@ class Model {
         vector<Vertex> vertices;
         vector<unsigned int> indices;
         vector<Texture> textures;
+        AABB bounds;
 
         // walk through each of the mesh's vertices
         for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
@@ -112,6 +214,7 @@ class Model {
             vector.y = mesh->mVertices[i].y;
             vector.z = mesh->mVertices[i].z;
             vertex.Position = vector;
+            bounds.add(vector);
             // normals
             if (mesh->HasNormals()) {
                 vector.x = mesh->mNormals[i].x;
@@ -185,7 +288,24 @@ class Model {
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
 
         // return a mesh object created from the extracted mesh data
-        return { vertices, indices, textures };
+        return { vertices, indices, textures, bounds,
+                 isAlphaTested(material, diffuseMaps) };
+    }
+
+    // a material is alpha-tested if the MTL gives it a dissolve map
+    // (map_d) or a dissolve (d) below 1, or if its diffuse texture has
+    // texels the geometry pass would discard
+    static bool
+    isAlphaTested(aiMaterial *material, const vector<Texture> &diffuseMaps) {
+        if (material->GetTextureCount(aiTextureType_OPACITY) > 0) return true;
+        float opacity = 1.0f;
+        if (material->Get(AI_MATKEY_OPACITY, opacity) == aiReturn_SUCCESS &&
+            opacity < 1.0f)
+            return true;
+        for (const Texture &texture : diffuseMaps) {
+            if (texture.cutout) return true;
+        }
+        return false;
     }
 
     // checks all material textures of a given type and loads the textures if
@@ -197,37 +317,38 @@ class Model {
         for (unsigned int i = 0; i < mat->GetTextureCount(type); i++) {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next
-            // iteration: skip loading a new texture
-            bool skip = false;
-            for (auto &j : textures_loaded) {
-                if (std::strcmp(j.path.data(), str.C_Str()) == 0) {
-                    textures.push_back(j);
-                    skip = true; // a texture with the same filepath has already
-                                 // been loaded, continue to next one.
-                                 // (optimization)
-                    break;
-                }
-            }
-            if (!skip) { // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(
-                    str.C_Str(), this->directory, gammaCorrection);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(
-                    texture); // store it as texture loaded for entire model, to
-                              // ensure we won't unnecesery load duplicate
-                              // textures.
-            }
+            textures.push_back(loadTexture(str.C_Str(), typeName));
         }
         return textures;
     }
+
+    // loads the texture at the given path relative to the model directory,
+    // unless it has been loaded for this model already.
+    Texture loadTexture(const char *path, const string &typeName) {
+        // check if texture was loaded before and if so, reuse it
+        for (auto &j : textures_loaded) {
+            if (std::strcmp(j.path.data(), path) == 0) {
+                return j; // a texture with the same filepath has already
+                          // been loaded (optimization)
+            }
+        }
+        Texture texture;
+        texture.id = TextureFromFile(
+            path, this->directory, gammaCorrection, &texture.cutout);
+        texture.type = typeName;
+        texture.path = path;
+        textures_loaded.push_back(
+            texture); // store it as texture loaded for entire model, to
+                      // ensure we won't unnecesery load duplicate
+                      // textures.
+        return texture;
+    }
 };
 
-unsigned int
-TextureFromFile(const char *path, const string &directory, bool gamma) {
+// loads a texture with mipmaps; `cutout` is set if it has an alpha channel
+// with texels below the geometry pass's alpha test threshold
+unsigned int TextureFromFile(
+    const char *path, const string &directory, bool gamma, bool *cutout) {
     string filename = string(path);
     filename = directory + '/' + filename;
 
@@ -251,8 +372,15 @@ TextureFromFile(const char *path, const string &directory, bool gamma) {
         } else {
             assert(false);
         }
+        if (cutout) {
+            // alpha 26/255 is the first value at or above the 0.1 threshold
+            const int texels = nrComponents == 4 ? width * height : 0;
+            *cutout = false;
+            for (int i = 0; i < texels && !*cutout; i++)
+                *cutout = data[4 * i + 3] < 26;
+        }
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
+        GLState::get().bindTexture(GL_TEXTURE_2D, textureID);
         glTexImage2D(
             GL_TEXTURE_2D, 0, internalFormat, width, height, 0, dataFormat,
             GL_UNSIGNED_BYTE, data);
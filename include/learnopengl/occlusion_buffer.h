@@ -0,0 +1,145 @@
+#ifndef OCCLUSION_BUFFER_H
+#define OCCLUSION_BUFFER_H
+
+#include <learnopengl/aabb.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Low-resolution depth of an earlier frame together with the
+// view-projection it was rendered with. Every texel holds the farthest
+// window-space depth of the pixels it covers, so a box is occluded if its
+// nearest depth lies behind every texel its screen rectangle touches.
+//
+// Boxes are reprojected into the earlier frame rather than the depth into
+// this one: static occluders stay exact under camera motion, while objects
+// that just came into view may show up a few frames late and moving
+// occluders are off by their motion.
+//
+// commit() adds a coarse level holding the farthest depth of every
+// TILE_SIZE square, so most of a large box is rejected a tile at a time.
+class OcclusionBuffer {
+
+  public:
+    static const unsigned TILE_SIZE = 8;
+
+    // makes room for a width x height depth image, rows bottom-up like
+    // glReadPixels, to be written through the returned pointer before
+    // calling commit()
+    float *reset(
+        const unsigned width, const unsigned height,
+        const glm::mat4 &viewProjection) {
+        m_width = width;
+        m_height = height;
+        m_viewProjection = viewProjection;
+        m_depths.resize(static_cast<std::size_t>(width) * height);
+        m_tiles.clear();
+        return m_depths.data();
+    }
+
+    // builds the tile level once the depths have been written
+    void commit() {
+        m_tilesX = (m_width + TILE_SIZE - 1) / TILE_SIZE;
+        m_tilesY = (m_height + TILE_SIZE - 1) / TILE_SIZE;
+        m_tiles.assign(static_cast<std::size_t>(m_tilesX) * m_tilesY, 0.0f);
+        for (unsigned y = 0; y < m_height; y++) {
+            const float *row = &m_depths[static_cast<std::size_t>(y) * m_width];
+            float *tiles = &m_tiles[(y / TILE_SIZE) * m_tilesX];
+            for (unsigned x = 0; x < m_width; x++) {
+                float &tile = tiles[x / TILE_SIZE];
+                tile = std::max(tile, row[x]);
+            }
+        }
+    }
+
+    // nothing is occluded until the next reset()
+    void clear() {
+        m_width = m_height = 0;
+        m_depths.clear();
+        m_tiles.clear();
+    }
+
+    // true before the first commit() after a reset() as well
+    bool empty() const { return m_tiles.empty(); }
+
+    unsigned width() const { return m_width; }
+
+    unsigned height() const { return m_height; }
+
+    // true only if the whole box was in view and hidden in the earlier
+    // frame; boxes crossing its near plane or screen edges are visible
+    bool occluded(const AABB &box) const {
+        if (empty() || box.empty()) return false;
+        glm::vec2 lo { 1.0f, 1.0f };
+        glm::vec2 hi { -1.0f, -1.0f };
+        float nearest = 1.0f;
+        for (int corner = 0; corner < 8; corner++) {
+            const glm::vec4 clip =
+                m_viewProjection *
+                glm::vec4(
+                    corner & 1 ? box.max.x : box.min.x,
+                    corner & 2 ? box.max.y : box.min.y,
+                    corner & 4 ? box.max.z : box.min.z, 1.0f);
+            if (clip.w <= 0.0f) return false;
+            const glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            lo = glm::min(lo, glm::vec2(ndc));
+            hi = glm::max(hi, glm::vec2(ndc));
+            nearest = std::min(nearest, 0.5f * ndc.z + 0.5f);
+        }
+        if (nearest < 0.0f || lo.x < -1.0f || lo.y < -1.0f || hi.x > 1.0f ||
+            hi.y > 1.0f)
+            return false;
+
+        const auto texel = [](const float ndc, const unsigned size) {
+            const int index = static_cast<int>(
+                std::floor((0.5f * ndc + 0.5f) * static_cast<float>(size)));
+            return std::min(std::max(index, 0), static_cast<int>(size) - 1);
+        };
+        const int x0 = texel(lo.x, m_width);
+        const int x1 = texel(hi.x, m_width);
+        const int y0 = texel(lo.y, m_height);
+        const int y1 = texel(hi.y, m_height);
+        const int tileSize = static_cast<int>(TILE_SIZE);
+        for (int tileY = y0 / tileSize; tileY <= y1 / tileSize; tileY++) {
+            for (int tileX = x0 / tileSize; tileX <= x1 / tileSize; tileX++) {
+                // the whole tile lies in front of the box
+                if (m_tiles[tileY * m_tilesX + tileX] < nearest) continue;
+                if (!occludedIn(
+                        std::max(x0, tileX * tileSize),
+                        std::max(y0, tileY * tileSize),
+                        std::min(x1, tileX * tileSize + tileSize - 1),
+                        std::min(y1, tileY * tileSize + tileSize - 1),
+                        nearest))
+                    return false;
+            }
+        }
+        return true;
+    }
+
+  private:
+    // whether every texel of the inclusive rectangle is nearer than `depth`
+    bool occludedIn(
+        const int x0, const int y0, const int x1, const int y1,
+        const float depth) const {
+        for (int y = y0; y <= y1; y++) {
+            const float *row = &m_depths[static_cast<std::size_t>(y) * m_width];
+            for (int x = x0; x <= x1; x++) {
+                if (row[x] >= depth) return false;
+            }
+        }
+        return true;
+    }
+
+    unsigned m_width { 0u };
+    unsigned m_height { 0u };
+    glm::mat4 m_viewProjection { 1.0f };
+    std::vector<float> m_depths;
+    unsigned m_tilesX { 0u };
+    unsigned m_tilesY { 0u };
+    std::vector<float> m_tiles;
+};
+
+#endif // OCCLUSION_BUFFER_H
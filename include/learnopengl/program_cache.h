@@ -0,0 +1,177 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/gl43.h>
+
+#include <sys/stat.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// On-disk cache of linked program binaries (glGetProgramBinary). Entries
+// live in directory(), one file per program, named after a 64-bit FNV-1a key
+// over the driver's vendor, renderer and version strings and the
+// preprocessed sources, so a driver update or an edited shader simply
+// misses. A binary the driver rejects is counted as a miss and the program
+// is compiled from source again.
+//
+// File layout: CachedProgramHeader, then `length` bytes of binary.
+struct CachedProgramHeader {
+    char magic[4];
+    uint32_t format;
+    uint32_t length;
+    uint32_t reserved;
+    uint64_t key;
+};
+
+class ProgramCache {
+
+  public:
+    struct Stats {
+        unsigned hits;
+        unsigned misses;
+        // time spent creating programs, cached or not
+        double milliseconds;
+    };
+
+    static ProgramCache &get() {
+        static ProgramCache cache;
+        return cache;
+    }
+
+    ProgramCache(const ProgramCache &) = delete;
+    ProgramCache &operator=(const ProgramCache &) = delete;
+
+    // needs program binary support, see gl43::programBinarySupported()
+    bool enabled() const { return gl43::programBinarySupported(); }
+
+    // key of a program built from the given preprocessed stage sources
+    uint64_t key(const std::vector<std::string> &sources) {
+        if (m_driver.empty()) {
+            for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+                const auto value =
+                    reinterpret_cast<const char *>(glGetString(name));
+                m_driver += value ? value : "";
+                m_driver += '\n';
+            }
+        }
+        uint64_t key = hash(14695981039346656037ull, m_driver);
+        for (const std::string &source : sources) {
+            // the terminating zero separates the stages
+            key = hash(key, source.c_str(), source.size() + 1);
+        }
+        return key;
+    }
+
+    // links `program` from the cached binary; false on a miss or when the
+    // driver rejects the binary, `program` can then be built from source
+    bool load(const GLuint program, const uint64_t key) {
+        if (!enabled()) return miss();
+
+        std::ifstream in(path(key), std::ios::binary);
+        CachedProgramHeader header {};
+        if (!in.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+            std::memcmp(header.magic, magic(), sizeof(header.magic)) != 0 ||
+            header.key != key)
+            return miss();
+        std::vector<char> binary(header.length);
+        if (!in.read(binary.data(), binary.size())) return miss();
+
+        glProgramBinary(program, header.format, binary.data(), header.length);
+        GLint success = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success) return miss();
+        m_stats.hits++;
+        return true;
+    }
+
+    // call before linking a program that will be stored
+    void prepare(const GLuint program) const {
+        if (enabled())
+            glProgramParameteri(
+                program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    // writes the binary of a successfully linked program
+    void store(const GLuint program, const uint64_t key) {
+        if (!enabled()) return;
+        GLint success = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (!success || length <= 0) return;
+
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(program, length, &length, &format, binary.data());
+
+        mkdir(directory(), 0755);
+        std::ofstream out(path(key), std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cerr << "ProgramCache::Failed to write: " << path(key)
+                      << std::endl;
+            return;
+        }
+        CachedProgramHeader header {};
+        std::memcpy(header.magic, magic(), sizeof(header.magic));
+        header.format = format;
+        header.length = length;
+        header.key = key;
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(binary.data(), length);
+    }
+
+    void addTime(const std::chrono::steady_clock::duration duration) {
+        m_stats.milliseconds +=
+            std::chrono::duration<double, std::milli>(duration).count();
+    }
+
+    const Stats &stats() const { return m_stats; }
+
+  private:
+    ProgramCache() = default;
+
+    // relative to the working directory, like resources/
+    static const char *directory() { return "shader_cache"; }
+
+    static const char *magic() { return "PBIN"; }
+
+    static std::string path(const uint64_t key) {
+        char name[32];
+        std::snprintf(
+            name, sizeof(name), "/%016llx.bin",
+            static_cast<unsigned long long>(key));
+        return directory() + std::string(name);
+    }
+
+    static uint64_t
+    hash(uint64_t hash, const char *data, const std::size_t size) {
+        for (std::size_t i = 0; i < size; i++) {
+            hash ^= static_cast<unsigned char>(data[i]);
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    static uint64_t hash(const uint64_t seed, const std::string &data) {
+        return hash(seed, data.data(), data.size());
+    }
+
+    bool miss() {
+        m_stats.misses++;
+        return false;
+    }
+
+    std::string m_driver;
+    Stats m_stats {};
+};
+
+#endif // PROGRAM_CACHE_H
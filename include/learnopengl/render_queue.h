@@ -0,0 +1,427 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/geometry_pool.h>
+#include <learnopengl/gl43.h>
+#include <learnopengl/gpu_culling.h>
+#include <learnopengl/instance_buffer.h>
+#include <learnopengl/mesh.h>
+#include <learnopengl/shader.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// passes of a frame in execution order; the depth passes draw positions only
+enum class RenderPass : unsigned {
+    DepthOpaque,
+    DepthAlphaTested,
+    GeometryOpaque,
+    GeometryAlphaTested,
+    LightSources
+};
+
+// Draws of one frame, submitted in any order and executed pass by pass with
+// as few state changes as possible. Every draw gets a 64-bit sort key,
+// most significant bits first:
+//
+//   pass (4) | program (12) | material (24) | depth (24)
+//
+// so sorting groups the draws of a pass by program, then by texture set,
+// then front to back. Executing a pass only changes the program, the
+// textures and the "model" uniform where they differ from the previous
+// draw.
+//
+// Per frame: begin(), submit everything, sort(), then execute() each pass.
+//
+// With multiDraw() (GL 4.3), every run of draws sharing program, vertex
+// stream and textures becomes one glMultiDrawElementsIndirect call over the
+// GeometryPool. Each indirect command's baseInstance points at its model
+// matrices in a per-frame transform buffer, fed to attributes 5-8 like an
+// InstanceBuffer, so all programs then have to read the model matrix from
+// there (the INSTANCED shader variants).
+//
+// Instances culled by GpuCulling are always drawn indirectly, on either
+// path: their command's instanceCount is copied from the GPU-side count of
+// survivors, and the survivors' buffer feeds attributes 5-8 directly.
+class RenderQueue {
+
+  public:
+    struct Stats {
+        // meshes drawn and the GL draw calls they took
+        unsigned draws;
+        unsigned calls;
+        unsigned programChanges;
+        unsigned materialChanges;
+        unsigned modelChanges;
+    };
+
+    RenderQueue() = default;
+
+    RenderQueue(const RenderQueue &) = delete;
+    RenderQueue &operator=(const RenderQueue &) = delete;
+
+    ~RenderQueue() {
+        glDeleteBuffers(1, &m_transformBuffer);
+        glDeleteBuffers(1, &m_commandBuffer);
+    }
+
+    bool multiDraw() const { return m_multiDraw; }
+
+    // stays off without GL 4.3; takes effect with the next begin()
+    void setMultiDraw(const bool multiDraw) {
+        m_multiDraw = multiDraw && gl43::supported();
+    }
+
+    // drops last frame's draws; depth keys are the distance from `eye`,
+    // quantized over [0, farPlane]
+    void begin(const glm::vec3 &eye, const float farPlane) {
+        m_cpuMilliseconds[m_frameMultiDraw] =
+            std::chrono::duration<float, std::milli>(m_cpuTime).count();
+        m_cpuTime = {};
+        m_frameMultiDraw = m_multiDraw;
+        m_items.clear();
+        m_order.clear();
+        m_models.clear();
+        m_culledDraws = 0;
+        m_eye = eye;
+        m_farPlane = farPlane;
+        m_stats = Stats {};
+    }
+
+    // model matrix shared by the following submit() calls, e.g. by all
+    // meshes of a model; returns its index
+    unsigned addModel(const glm::mat4 &matrix) {
+        m_models.push_back(matrix);
+        return m_models.size() - 1;
+    }
+
+    // a draw of `mesh` with the model matrix of index `model`
+    void submit(
+        const RenderPass pass, Shader &shader, Mesh &mesh,
+        const unsigned model) {
+        const glm::vec3 center = glm::vec3(
+            m_models[model] * glm::vec4(mesh.bounds.center(), 1.0f));
+        push(
+            pass, shader, mesh, model, nullptr, nullptr,
+            glm::length(center - m_eye));
+    }
+
+    // one draw of `mesh` per model matrix in `instances`
+    void submit(
+        const RenderPass pass, Shader &shader, Mesh &mesh,
+        const InstanceBuffer &instances) {
+        if (instances.count() == 0) return;
+        push(pass, shader, mesh, NO_MODEL, &instances, nullptr, 0.0f);
+    }
+
+    // one draw of `mesh` per instance that survived GPU culling; `shader`
+    // must read the model matrix from attributes 5-8
+    void submit(
+        const RenderPass pass, Shader &shader, Mesh &mesh,
+        const GpuCulling &instances) {
+        if (instances.count() == 0) return;
+        push(pass, shader, mesh, NO_MODEL, nullptr, &instances, 0.0f);
+        m_culledDraws++;
+    }
+
+    // LSD radix sort of the keys, one byte per round; rounds in which every
+    // key has the same byte are skipped
+    void sort() {
+        const auto start = std::chrono::steady_clock::now();
+        m_scratch.resize(m_order.size());
+        for (unsigned shift = 0; shift < 64 && !m_order.empty(); shift += 8) {
+            std::size_t offsets[256] = {};
+            for (const SortEntry &entry : m_order)
+                offsets[(entry.key >> shift) & 0xFF]++;
+            if (offsets[(m_order.front().key >> shift) & 0xFF] ==
+                m_order.size())
+                continue;
+            std::size_t offset = 0;
+            for (std::size_t &count : offsets) {
+                const std::size_t digitCount = count;
+                count = offset;
+                offset += digitCount;
+            }
+            for (const SortEntry &entry : m_order)
+                m_scratch[offsets[(entry.key >> shift) & 0xFF]++] = entry;
+            m_order.swap(m_scratch);
+        }
+        if (m_frameMultiDraw || m_culledDraws > 0) buildCommands();
+        m_cpuTime += std::chrono::steady_clock::now() - start;
+    }
+
+    // draws the sorted items of one pass into the bound framebuffer
+    void execute(const RenderPass pass) {
+        const auto start = std::chrono::steady_clock::now();
+        const auto byKey = [](const SortEntry &entry, const uint64_t key) {
+            return entry.key < key;
+        };
+        const auto begin = std::lower_bound(
+            m_order.begin(), m_order.end(), passKey(pass), byKey);
+        const auto end = std::lower_bound(
+            begin, m_order.end(), passKey(pass) + PASS_SPAN, byKey);
+        const bool positions = positionsOnly(pass);
+
+        // other code binds programs and textures between passes
+        Shader *shader = nullptr;
+        const Uniform<glm::mat4> *modelHandle = nullptr;
+        const Mesh *material = nullptr;
+        unsigned model = NO_MODEL;
+        for (auto it = begin; it != end;) {
+            const Item &item = m_items[it->index];
+            if (item.shader != shader) {
+                shader = item.shader;
+                shader->use();
+                modelHandle = &modelUniform(*shader);
+                material = nullptr;
+                model = NO_MODEL;
+                m_stats.programChanges++;
+            }
+            const bool textured = !positions || item.mesh->alphaTested;
+            if (textured &&
+                (!material || !material->SameMaterial(*item.mesh))) {
+                item.mesh->BindMaterial(*shader);
+                material = item.mesh;
+                m_stats.materialChanges++;
+            }
+            if (m_frameMultiDraw || item.culled) {
+                it = multiDraw(it, end, positions);
+                continue;
+            }
+            if (item.model != NO_MODEL && item.model != model) {
+                modelHandle->set(m_models[item.model]);
+                model = item.model;
+                m_stats.modelChanges++;
+            }
+            item.mesh->DrawGeometry(positions, item.instances);
+            m_stats.draws++;
+            m_stats.calls++;
+            ++it;
+        }
+        m_cpuTime += std::chrono::steady_clock::now() - start;
+    }
+
+    // counts of the passes executed since begin()
+    const Stats &stats() const { return m_stats; }
+
+    // CPU time of the last frame's sort() and execute() calls, i.e. of
+    // building and issuing the draws, for the direct or multi-draw path
+    float cpuMilliseconds(const bool multiDraw) const {
+        return m_cpuMilliseconds[multiDraw];
+    }
+
+  private:
+    static const unsigned NO_MODEL = ~0u;
+    // keys of one pass lie in [passKey(pass), passKey(pass) + PASS_SPAN)
+    static const uint64_t PASS_SPAN = 1ull << 60;
+
+    struct Item {
+        Shader *shader;
+        Mesh *mesh;
+        unsigned model;
+        const InstanceBuffer *instances;
+        const GpuCulling *culled;
+    };
+
+    struct ModelUniform {
+        const Shader *shader;
+        Uniform<glm::mat4> uniform;
+    };
+
+    struct SortEntry {
+        uint64_t key;
+        unsigned index;
+    };
+
+    // layout defined by glMultiDrawElementsIndirect
+    struct DrawCommand {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    // vertex stream a draw reads, see Mesh::DrawGeometry()
+    static bool positionStream(const Item &item, const bool positionsOnly) {
+        return positionsOnly && !item.mesh->alphaTested;
+    }
+
+    // buffer an indirect draw reads its model matrices from
+    GLuint instanceSource(const Item &item) const {
+        return item.culled ? item.culled->id() : m_transformBuffer;
+    }
+
+    // one indirect command per sorted draw, in sort order, and, for
+    // multi-draw, the model matrices they point at. Culled draws start at
+    // their own buffer's first instance and get their count on the GPU.
+    void buildCommands() {
+        if (!m_transformBuffer) {
+            glGenBuffers(1, &m_transformBuffer);
+            glGenBuffers(1, &m_commandBuffer);
+        }
+        m_commands.clear();
+        m_transforms.clear();
+        for (const SortEntry &entry : m_order) {
+            const Item &item = m_items[entry.index];
+            const GeometryPool::Range &range = item.mesh->range;
+            if (item.culled) {
+                m_commands.push_back(DrawCommand {
+                    static_cast<GLuint>(range.indexCount), 0u,
+                    range.firstIndex, range.baseVertex, 0u });
+                continue;
+            }
+            const GLuint instances =
+                item.instances ? item.instances->count() : 1u;
+            m_commands.push_back(DrawCommand {
+                static_cast<GLuint>(range.indexCount), instances,
+                range.firstIndex, range.baseVertex,
+                static_cast<GLuint>(m_transforms.size()) });
+            if (!m_frameMultiDraw) continue;
+            // instance matrices are copied on the GPU below
+            m_transforms.resize(m_transforms.size() + instances);
+            if (!item.instances) m_transforms.back() = m_models[item.model];
+        }
+
+        if (m_frameMultiDraw) {
+            glBindBuffer(GL_ARRAY_BUFFER, m_transformBuffer);
+            glBufferData(
+                GL_ARRAY_BUFFER, m_transforms.size() * sizeof(glm::mat4),
+                m_transforms.data(), GL_STREAM_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, m_transformBuffer);
+            for (std::size_t i = 0; i < m_order.size(); i++) {
+                const InstanceBuffer *instances =
+                    m_items[m_order[i].index].instances;
+                if (!instances) continue;
+                glBindBuffer(GL_COPY_READ_BUFFER, instances->id());
+                glCopyBufferSubData(
+                    GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0,
+                    m_commands[i].baseInstance * sizeof(glm::mat4),
+                    instances->count() * sizeof(glm::mat4));
+            }
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+        glBufferData(
+            GL_DRAW_INDIRECT_BUFFER, m_commands.size() * sizeof(DrawCommand),
+            m_commands.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+        // the survivor counts go straight into the culled draws' commands
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_commandBuffer);
+        for (std::size_t i = 0; i < m_order.size(); i++) {
+            const GpuCulling *culled = m_items[m_order[i].index].culled;
+            if (!culled) continue;
+            glBindBuffer(GL_COPY_READ_BUFFER, culled->countBuffer());
+            glCopyBufferSubData(
+                GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0,
+                i * sizeof(DrawCommand) + offsetof(DrawCommand, instanceCount),
+                sizeof(GLuint));
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    // draws `first` and the following draws that share its program, vertex
+    // stream, textures and instance buffer with one call, the program and
+    // textures already bound; returns the first draw after them
+    std::vector<SortEntry>::iterator multiDraw(
+        const std::vector<SortEntry>::iterator first,
+        const std::vector<SortEntry>::iterator end,
+        const bool positionsOnly) {
+        const Item &item = m_items[first->index];
+        const bool stream = positionStream(item, positionsOnly);
+        const GLuint source = instanceSource(item);
+        auto last = first + 1;
+        while (last != end) {
+            const Item &next = m_items[last->index];
+            if (next.shader != item.shader ||
+                positionStream(next, positionsOnly) != stream ||
+                instanceSource(next) != source ||
+                (!stream && !next.mesh->SameMaterial(*item.mesh)))
+                break;
+            ++last;
+        }
+
+        GeometryPool::get().bind(stream, source);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+        const std::size_t offset =
+            (first - m_order.begin()) * sizeof(DrawCommand);
+        glMultiDrawElementsIndirect(
+            GL_TRIANGLES, GL_UNSIGNED_INT,
+            reinterpret_cast<const void *>(offset),
+            static_cast<GLsizei>(last - first), 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        m_stats.draws += last - first;
+        m_stats.calls++;
+        return last;
+    }
+
+    // "model" uniform of a program, resolved on the program's first draw;
+    // a frame has few programs, so a linear search is enough
+    const Uniform<glm::mat4> &modelUniform(Shader &shader) {
+        for (const ModelUniform &entry : m_modelUniforms) {
+            if (entry.shader == &shader) return entry.uniform;
+        }
+        m_modelUniforms.push_back(ModelUniform {
+            &shader, shader.optionalHandle<glm::mat4>("model") });
+        return m_modelUniforms.back().uniform;
+    }
+
+    static uint64_t passKey(const RenderPass pass) {
+        return static_cast<uint64_t>(pass) << 60;
+    }
+
+    static bool positionsOnly(const RenderPass pass) {
+        return pass == RenderPass::DepthOpaque ||
+               pass == RenderPass::DepthAlphaTested;
+    }
+
+    void push(
+        const RenderPass pass, Shader &shader, Mesh &mesh,
+        const unsigned model, const InstanceBuffer *instances,
+        const GpuCulling *culled, const float distance) {
+        const float depth =
+            std::min(std::max(distance / m_farPlane, 0.0f), 1.0f);
+        // position-only draws bind no textures
+        const uint64_t material =
+            positionsOnly(pass) && !mesh.alphaTested ? 0u : mesh.MaterialKey();
+        const uint64_t key = passKey(pass) |
+                             static_cast<uint64_t>(shader.ID & 0xFFFu) << 48 |
+                             material << 24 |
+                             static_cast<uint64_t>(depth * 0xFFFFFF);
+        m_order.push_back(
+            SortEntry { key, static_cast<unsigned>(m_items.size()) });
+        m_items.push_back(Item { &shader, &mesh, model, instances, culled });
+    }
+
+    std::vector<Item> m_items;
+    std::vector<SortEntry> m_order;
+    std::vector<SortEntry> m_scratch;
+    std::vector<glm::mat4> m_models;
+    std::vector<ModelUniform> m_modelUniforms;
+    unsigned m_culledDraws { 0u };
+    bool m_multiDraw { false };
+    bool m_frameMultiDraw { false };
+    std::vector<DrawCommand> m_commands;
+    std::vector<glm::mat4> m_transforms;
+    GLuint m_transformBuffer { 0u };
+    GLuint m_commandBuffer { 0u };
+    std::chrono::steady_clock::duration m_cpuTime {};
+    float m_cpuMilliseconds[2] {};
+    glm::vec3 m_eye { 0.0f };
+    float m_farPlane { 1.0f };
+    Stats m_stats {};
+};
+
+#endif // RENDER_QUEUE_H
@@ -5,102 +5,275 @@
 #include <glm/glm.hpp>
 
 #include <common.h>
+#include <learnopengl/frame_constants.h>
+#include <learnopengl/gl43.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/program_cache.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <initializer_list>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 #include <string>
-#include <unordered_map>
-class Shader {
+#include <vector>
+
+// glUniform* for each value type a uniform can be set to
+inline void setUniform(GLint location, bool value) {
+    glUniform1i(location, (int) value);
+}
+inline void setUniform(GLint location, int value) {
+    glUniform1i(location, value);
+}
+inline void setUniform(GLint location, unsigned value) {
+    glUniform1ui(location, value);
+}
+inline void setUniform(GLint location, float value) {
+    glUniform1f(location, value);
+}
+inline void setUniform(GLint location, const glm::vec2 &value) {
+    glUniform2fv(location, 1, &value[0]);
+}
+inline void setUniform(GLint location, const glm::vec3 &value) {
+    glUniform3fv(location, 1, &value[0]);
+}
+inline void setUniform(GLint location, const glm::vec4 &value) {
+    glUniform4fv(location, 1, &value[0]);
+}
+inline void setUniform(GLint location, const glm::uvec3 &value) {
+    glUniform3uiv(location, 1, &value[0]);
+}
+inline void setUniform(GLint location, const glm::mat2 &mat) {
+    glUniformMatrix2fv(location, 1, GL_FALSE, &mat[0][0]);
+}
+inline void setUniform(GLint location, const glm::mat3 &mat) {
+    glUniformMatrix3fv(location, 1, GL_FALSE, &mat[0][0]);
+}
+inline void setUniform(GLint location, const glm::mat4 &mat) {
+    glUniformMatrix4fv(location, 1, GL_FALSE, &mat[0][0]);
+}
+
+// a uniform of one program resolved once by Shader::handle(); setting it
+// neither allocates nor looks up a name
+template <typename T> class Uniform {
   public:
-    unsigned int ID;
-    // constructor generates the shader on the fly
-    Shader(const char *vertexPath, const char *fragmentPath) {
-        auto vertex = loadShader(vertexPath, GL_VERTEX_SHADER);
-        auto fragment = loadShader(fragmentPath, GL_FRAGMENT_SHADER);
+    Uniform() = default;
 
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        glLinkProgram(ID);
-        checkLinkingErrors(ID);
+    // false for an optional uniform the program does not have
+    bool valid() const { return m_location != -1; }
 
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
+    void set(const T &value) const {
+        if (m_location == -1) return;
+        GLState::get().useProgram(m_program);
+        setUniform(m_location, value);
+    }
+
+  private:
+    friend class Shader;
+
+    Uniform(const GLuint program, const GLint location)
+        : m_program { program }
+        , m_location { location } {}
+
+    GLuint m_program { 0 };
+    GLint m_location { -1 };
+};
+
+class Shader {
+  public:
+    unsigned int ID;
+    // constructor generates the shader on the fly, or loads it from the
+    // program binary cache. Each of `defines` ("NAME" or "NAME value") is
+    // injected as a #define right after the #version line of both stages.
+    Shader(
+        const char *vertexPath, const char *fragmentPath,
+        const std::vector<std::string> &defines = {}) {
+        build(
+            { { GL_VERTEX_SHADER, vertexPath },
+              { GL_FRAGMENT_SHADER, fragmentPath } },
+            defines);
+    }
+    // compute program; needs a GL 4.3 context (see gl43.h)
+    explicit Shader(
+        const char *computePath,
+        const std::vector<std::string> &defines = {}) {
+        build({ { GL_COMPUTE_SHADER, computePath } }, defines);
     }
     // activate the shader
-    void use() const { glUseProgram(ID); }
+    void use() const { GLState::get().useProgram(ID); }
 
-    // utility uniform functions
-    void uniform(const std::string &name, bool value) {
+    // utility uniform functions for setup; each call looks the name up, so
+    // uniforms set every frame or every draw go through a handle() resolved
+    // at startup instead. Unknown names are reported once.
+    template <typename T> void uniform(const char *name, const T &value) {
+        const GLint loc = checkedLocation(name);
+        if (loc == -1) return;
         use();
-        glUniform1i(location(name), (int) value);
+        setUniform(loc, value);
     }
 
-    void uniform(const std::string &name, int value) {
-        use();
-        glUniform1i(location(name), value);
+    void uniform(const char *name, float x, float y) {
+        uniform(name, glm::vec2(x, y));
     }
 
-    void uniform(const std::string &name, float value) {
-        use();
-        glUniform1f(location(name), value);
+    void uniform(const char *name, float x, float y, float z) {
+        uniform(name, glm::vec3(x, y, z));
     }
 
-    void uniform(const std::string &name, const glm::vec2 &value) {
-        use();
-        glUniform2fv(location(name), 1, &value[0]);
+    void uniform(const char *name, float x, float y, float z, float w) {
+        uniform(name, glm::vec4(x, y, z, w));
     }
 
-    void uniform(const std::string &name, float x, float y) {
-        use();
-        glUniform2f(location(name), x, y);
+    // typed handle for uniforms set often; unknown names are reported
+    template <typename T> Uniform<T> handle(const char *name) {
+        return Uniform<T>(ID, checkedLocation(name));
     }
 
-    void uniform(const std::string &name, const glm::vec3 &value) {
-        glUniform3fv(location(name), 1, &value[0]);
+    // handle of a uniform the program may lack, e.g. "model" in the
+    // instanced variants; setting it then does nothing
+    template <typename T> Uniform<T> optionalHandle(const char *name) const {
+        return Uniform<T>(ID, location(name));
     }
 
-    void uniform(const std::string &name, float x, float y, float z) {
-        use();
-        glUniform3f(location(name), x, y, z);
+    // assigns the named uniform block to a uniform buffer binding point
+    void uniformBlock(const std::string &name, GLuint binding) {
+        const GLuint index = glGetUniformBlockIndex(ID, name.c_str());
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(ID, index, binding);
     }
 
-    void uniform(const std::string &name, const glm::vec4 &value) {
-        use();
-        glUniform4fv(location(name), 1, &value[0]);
+    // location of an active uniform, or -1 for optional uniforms the
+    // program does not have
+    GLint location(const char *name) const {
+        const auto it = std::lower_bound(
+            m_uniforms.begin(), m_uniforms.end(), name,
+            [](const ActiveUniform &uniform, const char *key) {
+                return std::strcmp(uniform.name.c_str(), key) < 0;
+            });
+        if (it == m_uniforms.end() || it->name != name) return -1;
+        return it->location;
     }
 
-    void uniform(const std::string &name, float x, float y, float z, float w) {
-        use();
-        glUniform4f(location(name), x, y, z, w);
+    GLint location(const std::string &name) const {
+        return location(name.c_str());
     }
 
-    void uniform(const std::string &name, const glm::mat2 &mat) {
-        use();
-        glUniformMatrix2fv(location(name), 1, GL_FALSE, &mat[0][0]);
+  private:
+    struct Stage {
+        GLenum type;
+        const char *path;
+    };
+
+    void build(
+        std::initializer_list<Stage> stages,
+        const std::vector<std::string> &defines) {
+        const auto start = std::chrono::steady_clock::now();
+        ProgramCache &cache = ProgramCache::get();
+        ID = glCreateProgram();
+
+        std::vector<std::string> sources;
+        bool read = true;
+        for (const Stage &stage : stages) {
+            sources.emplace_back();
+            read = readSource(stage.path, sources.back()) && read;
+            injectDefines(sources.back(), defines);
+        }
+        const uint64_t key = cache.key(sources);
+        if (!read || !cache.load(ID, key)) {
+            std::vector<GLuint> shaders;
+            auto source = sources.begin();
+            for (const Stage &stage : stages) {
+                shaders.push_back(compileShader(*source++, stage.type));
+                glAttachShader(ID, shaders.back());
+            }
+            if (read) cache.prepare(ID);
+            glLinkProgram(ID);
+            checkLinkingErrors(ID);
+            if (read) cache.store(ID, key);
+            for (GLuint shader : shaders)
+                glDeleteShader(shader);
+        }
+        reflectUniforms();
+        uniformBlock("FrameConstants", FrameConstants::BINDING);
+        cache.addTime(std::chrono::steady_clock::now() - start);
     }
 
-    void uniform(const std::string &name, const glm::mat3 &mat) {
-        use();
-        glUniformMatrix3fv(location(name), 1, GL_FALSE, &mat[0][0]);
+    static void
+    injectDefines(std::string &code, const std::vector<std::string> &defines) {
+        if (defines.empty()) return;
+        std::string lines;
+        for (const std::string &define : defines)
+            lines += "#define " + define + "\n";
+        const auto version = code.find("#version");
+        const auto end = version == std::string::npos
+                             ? std::string::npos
+                             : code.find('\n', version);
+        code.insert(end == std::string::npos ? 0 : end + 1, lines);
     }
 
-    void uniform(const std::string &name, const glm::mat4 &mat) {
-        use();
-        glUniformMatrix4fv(location(name), 1, GL_FALSE, &mat[0][0]);
+    struct ActiveUniform {
+        std::string name;
+        GLint location;
+    };
+
+    // records the location of every active uniform outside of uniform
+    // blocks, sorted by name; arrays are listed without their "[0]"
+    void reflectUniforms() {
+        GLint count = 0;
+        GLint maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> name(std::max(maxLength, 1));
+        for (GLint i = 0; i < count; i++) {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(
+                ID, i, maxLength, &length, &size, &type, name.data());
+            const GLint loc = glGetUniformLocation(ID, name.data());
+            if (loc == -1) continue;
+            std::string uniformName(name.data(), length);
+            const auto bracket = uniformName.find("[0]");
+            if (bracket != std::string::npos) uniformName.resize(bracket);
+            m_uniforms.push_back(ActiveUniform { uniformName, loc });
+        }
+        std::sort(
+            m_uniforms.begin(), m_uniforms.end(),
+            [](const ActiveUniform &a, const ActiveUniform &b) {
+                return a.name < b.name;
+            });
     }
 
-  private:
-    GLint location(const std::string &name) {
-        const auto iloc = m_location.find(name);
-        if (iloc == m_location.end()) {
-            return m_location[name] = glGetUniformLocation(ID, name.c_str());
+    GLint checkedLocation(const char *name) {
+        const GLint loc = location(name);
+        if (loc == -1 &&
+            std::find(m_unknown.begin(), m_unknown.end(), name) ==
+                m_unknown.end()) {
+            m_unknown.emplace_back(name);
+            std::cout << "ERROR::SHADER::UNKNOWN_UNIFORM: " << name
+                      << " (program " << ID << ")" << std::endl;
         }
-        return iloc->second;
+        return loc;
     }
 
-    static GLuint loadShader(const char *path, GLenum type) {
-        std::string code;
+    static GLuint compileShader(const std::string &code, GLenum type) {
+        auto ccode = code.c_str();
+
+        auto shader = glCreateShader(type);
+        glShaderSource(shader, 1, &ccode, nullptr);
+        glCompileShader(shader);
+        checkCompileErrors(shader, type);
+
+        return shader;
+    }
+
+    // reads a shader source, splicing in files referenced by
+    // #include "file" lines (relative to the including file). The
+    // GL_GOOGLE_include_directive extension line, which lets
+    // glslangValidator accept the includes, is dropped here.
+    static bool readSource(const std::string &path, std::string &code) {
+        std::string source;
         try {
             std::ifstream file;
             file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
@@ -109,21 +282,33 @@ class Shader {
 
             std::stringstream stream;
             stream << file.rdbuf();
-            code = stream.str();
+            source = stream.str();
         } catch (std::ifstream::failure &) {
-            std::cerr << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ"
+            std::cerr << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << path
                       << std::endl;
-            return 0;
+            return false;
         }
 
-        auto ccode = code.c_str();
-
-        auto shader = glCreateShader(type);
-        glShaderSource(shader, 1, &ccode, nullptr);
-        glCompileShader(shader);
-        checkCompileErrors(shader, type);
-
-        return shader;
+        const auto directory = path.substr(0, path.find_last_of('/') + 1);
+        std::istringstream lines(source);
+        std::string line;
+        while (std::getline(lines, line)) {
+            if (line.find("GL_GOOGLE_include_directive") != std::string::npos)
+                continue;
+            if (line.compare(0, 8, "#include") == 0) {
+                const auto begin = line.find('"');
+                const auto end = line.find('"', begin + 1);
+                if (begin == std::string::npos || end == std::string::npos ||
+                    !readSource(
+                        directory + line.substr(begin + 1, end - begin - 1),
+                        code))
+                    return false;
+                continue;
+            }
+            code += line;
+            code += '\n';
+        }
+        return true;
     }
 
     // utility function for checking shader compilation errors.
@@ -135,8 +320,9 @@ class Shader {
             glGetShaderInfoLog(shader, 1024, nullptr, infoLog);
             std::cout
                 << "ERROR::SHADER_COMPILATION_ERROR::"
-                << (type == GL_VERTEX_SHADER ? "VERTEX_SHADER"
-                                             : "FRAGMENT_SHADER")
+                << (type == GL_VERTEX_SHADER     ? "VERTEX_SHADER"
+                    : type == GL_FRAGMENT_SHADER ? "FRAGMENT_SHADER"
+                                                 : "COMPUTE_SHADER")
                 << "\n"
                 << infoLog
                 << "\n -- --------------------------------------------------- "
@@ -161,6 +347,8 @@ class Shader {
         }
     }
 
-    std::unordered_map<std::string, GLint> m_location;
+    std::vector<ActiveUniform> m_uniforms;
+    // names already reported as unknown
+    std::vector<std::string> m_unknown;
 };
 #endif
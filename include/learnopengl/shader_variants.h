@@ -0,0 +1,99 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include <learnopengl/shader.h>
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// a uniform of all variants of a ShaderVariants resolved once by
+// ShaderVariants::handle(); variants without it are skipped
+template <typename T> class VariantUniform {
+  public:
+    VariantUniform() = default;
+
+    void set(const T &value) const {
+        for (const Uniform<T> &uniform : m_uniforms)
+            uniform.set(value);
+    }
+
+  private:
+    friend class ShaderVariants;
+
+    std::vector<Uniform<T>> m_uniforms;
+};
+
+// Permutations of one vertex/fragment program over a list of on/off feature
+// defines. Every combination is compiled up front (cheap with the program
+// binary cache), so toggling a feature switches programs instead of
+// branching on a uniform in every pixel. Bit i of a variant key enables
+// `#define features[i]`; `defines` go into every variant.
+class ShaderVariants {
+
+  public:
+    ShaderVariants(
+        const char *vertexPath, const char *fragmentPath,
+        const std::vector<std::string> &features,
+        const std::vector<std::string> &defines = {})
+        : m_features { features } {
+        for (unsigned key = 0; key < (1u << features.size()); key++) {
+            std::vector<std::string> variantDefines { defines };
+            for (std::size_t i = 0; i < features.size(); i++) {
+                if (key & (1u << i)) variantDefines.push_back(features[i]);
+            }
+            m_variants.push_back(std::make_unique<Shader>(
+                vertexPath, fragmentPath, variantDefines));
+        }
+    }
+
+    // key bit of the named feature, 0 if the feature does not exist
+    unsigned feature(const char *name) const {
+        for (std::size_t i = 0; i < m_features.size(); i++) {
+            if (m_features[i] == name) return 1u << i;
+        }
+        std::cout << "ERROR::SHADER::UNKNOWN_FEATURE: " << name << std::endl;
+        return 0;
+    }
+
+    Shader &operator[](const unsigned key) { return *m_variants[key]; }
+
+    // sets a uniform in every variant that has it; the name is only
+    // reported as unknown if no variant does
+    template <typename T> void uniform(const char *name, const T &value) {
+        bool found = false;
+        for (auto &variant : m_variants) {
+            const GLint location = variant->location(name);
+            if (location == -1) continue;
+            variant->use();
+            setUniform(location, value);
+            found = true;
+        }
+        if (!found) m_variants.front()->uniform(name, value);
+    }
+
+    // typed handle setting the uniform in every variant that has it; the
+    // name is reported as unknown if no variant does
+    template <typename T> VariantUniform<T> handle(const char *name) {
+        VariantUniform<T> handle;
+        bool found = false;
+        for (auto &variant : m_variants) {
+            handle.m_uniforms.push_back(variant->optionalHandle<T>(name));
+            found = found || handle.m_uniforms.back().valid();
+        }
+        if (!found) m_variants.front()->handle<T>(name);
+        return handle;
+    }
+
+    void uniformBlock(const std::string &name, GLuint binding) {
+        for (auto &variant : m_variants)
+            variant->uniformBlock(name, binding);
+    }
+
+  private:
+    std::vector<std::string> m_features;
+    std::vector<std::unique_ptr<Shader>> m_variants;
+};
+
+#endif // SHADER_VARIANTS_H
@@ -0,0 +1,557 @@
+#ifndef SOFTWARE_OCCLUSION_H
+#define SOFTWARE_OCCLUSION_H
+
+#include <learnopengl/aabb.h>
+#include <learnopengl/occlusion_buffer.h>
+
+#include <glm/glm.hpp>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// the few vector operations the occlusion rasterizer needs, WIDTH lanes
+// wide: AVX2 when the compiler targets it (the OCCLUSION_AVX2 CMake
+// option), SSE2 on any other x86-64, plain floats elsewhere
+namespace simd {
+
+#if defined(__AVX2__)
+const unsigned WIDTH = 8;
+using Float = __m256;
+using Mask = __m256;
+
+inline Float splat(const float value) { return _mm256_set1_ps(value); }
+inline Float lanes() { return _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7); }
+inline Float load(const float *p) { return _mm256_loadu_ps(p); }
+inline void store(float *p, const Float v) { _mm256_storeu_ps(p, v); }
+inline Float add(const Float a, const Float b) { return _mm256_add_ps(a, b); }
+inline Float mul(const Float a, const Float b) { return _mm256_mul_ps(a, b); }
+inline Float min(const Float a, const Float b) { return _mm256_min_ps(a, b); }
+inline Mask less(const Float a, const Float b) {
+    return _mm256_cmp_ps(a, b, _CMP_LT_OQ);
+}
+inline Mask notNegative(const Float a) {
+    return _mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_GE_OQ);
+}
+inline Mask atLeast(const Float a, const Float b) {
+    return _mm256_cmp_ps(a, b, _CMP_GE_OQ);
+}
+inline Mask both(const Mask a, const Mask b) { return _mm256_and_ps(a, b); }
+inline bool none(const Mask m) { return _mm256_movemask_ps(m) == 0; }
+inline unsigned bits(const Mask m) { return _mm256_movemask_ps(m); }
+inline Float select(const Mask m, const Float a, const Float b) {
+    return _mm256_blendv_ps(b, a, m);
+}
+#elif defined(__SSE2__)
+const unsigned WIDTH = 4;
+using Float = __m128;
+using Mask = __m128;
+
+inline Float splat(const float value) { return _mm_set1_ps(value); }
+inline Float lanes() { return _mm_setr_ps(0, 1, 2, 3); }
+inline Float load(const float *p) { return _mm_loadu_ps(p); }
+inline void store(float *p, const Float v) { _mm_storeu_ps(p, v); }
+inline Float add(const Float a, const Float b) { return _mm_add_ps(a, b); }
+inline Float mul(const Float a, const Float b) { return _mm_mul_ps(a, b); }
+inline Float min(const Float a, const Float b) { return _mm_min_ps(a, b); }
+inline Mask less(const Float a, const Float b) { return _mm_cmplt_ps(a, b); }
+inline Mask notNegative(const Float a) {
+    return _mm_cmpge_ps(a, _mm_setzero_ps());
+}
+inline Mask atLeast(const Float a, const Float b) { return _mm_cmpge_ps(a, b); }
+inline Mask both(const Mask a, const Mask b) { return _mm_and_ps(a, b); }
+inline bool none(const Mask m) { return _mm_movemask_ps(m) == 0; }
+inline unsigned bits(const Mask m) { return _mm_movemask_ps(m); }
+inline Float select(const Mask m, const Float a, const Float b) {
+    return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+}
+#else
+const unsigned WIDTH = 1;
+using Float = float;
+using Mask = bool;
+
+inline Float splat(const float value) { return value; }
+inline Float lanes() { return 0.0f; }
+inline Float load(const float *p) { return *p; }
+inline void store(float *p, const Float v) { *p = v; }
+inline Float add(const Float a, const Float b) { return a + b; }
+inline Float mul(const Float a, const Float b) { return a * b; }
+inline Float min(const Float a, const Float b) { return std::min(a, b); }
+inline Mask less(const Float a, const Float b) { return a < b; }
+inline Mask notNegative(const Float a) { return a >= 0.0f; }
+inline Mask atLeast(const Float a, const Float b) { return a >= b; }
+inline Mask both(const Mask a, const Mask b) { return a && b; }
+inline bool none(const Mask m) { return !m; }
+inline unsigned bits(const Mask m) { return m ? 1u : 0u; }
+inline Float select(const Mask m, const Float a, const Float b) {
+    return m ? a : b;
+}
+#endif
+
+} // namespace simd
+
+// Occlusion culling on the CPU: a few large occluders are rasterized at low
+// resolution into an OcclusionBuffer of this frame, which Frustum then
+// tests the boxes of every draw against before it is submitted. Unlike the
+// DepthPyramid readback it needs no GPU round trip, so nothing lags.
+//
+// Occluder shapes are registered once with addMesh(). Per frame: begin(),
+// addOccluder() for each placed shape, rasterize(). Queueing only records
+// the placement; rasterize() runs on the worker threads plus the caller,
+// first splitting the queued triangles between them for transform and
+// setup, then splitting the buffer into horizontal bands, and every band
+// runs the edge and depth tests simd::WIDTH pixels at a time. Triangles
+// are clipped against the near plane only; the rest is clamped to the
+// buffer.
+//
+// The rasterization is conservative, since an occluder must never hide
+// more than it covers: a pixel only takes the farthest depth a triangle
+// has over it, and only once it is covered completely. Pixels a triangle
+// covers in part collect its samples of a 4x4 grid in a coverage mask
+// instead, so the pixels along edges shared by two triangles fill up.
+class SoftwareOcclusion {
+
+  public:
+    // `width` is rounded up to whole SIMD rows; the caller's thread works
+    // on a band too, so `workers` may be 0
+    SoftwareOcclusion(
+        const unsigned width, const unsigned height,
+        const unsigned workers = defaultWorkers())
+        : m_setups(workers + 1) {
+        resize(width, height);
+        for (unsigned worker = 0; worker < workers; worker++)
+            m_workers.emplace_back(&SoftwareOcclusion::work, this, worker + 1);
+    }
+
+    SoftwareOcclusion(const SoftwareOcclusion &) = delete;
+    SoftwareOcclusion &operator=(const SoftwareOcclusion &) = delete;
+
+    ~SoftwareOcclusion() {
+        {
+            std::lock_guard<std::mutex> lock { m_mutex };
+            m_quit = true;
+        }
+        m_wake.notify_all();
+        for (std::thread &worker : m_workers)
+            worker.join();
+    }
+
+    // one worker per hardware thread besides the caller's
+    static unsigned defaultWorkers() {
+        const unsigned threads = std::thread::hardware_concurrency();
+        return threads > 1 ? threads - 1 : 0;
+    }
+
+    // takes effect with the next rasterize(); `width` is rounded up to
+    // whole SIMD rows
+    void resize(const unsigned width, const unsigned height) {
+        m_width = (width + simd::WIDTH - 1) / simd::WIDTH * simd::WIDTH;
+        m_height = height;
+    }
+
+    // keeps the positions and the indices of a triangle mesh as an
+    // occluder shape and returns its id for addOccluder(); any vertex type
+    // with a glm::vec3 Position works
+    template <typename Vertex>
+    unsigned addMesh(
+        const std::vector<Vertex> &vertices,
+        const std::vector<unsigned int> &indices) {
+        OccluderMesh mesh;
+        for (const Vertex &vertex : vertices)
+            mesh.positions.push_back(vertex.Position);
+        mesh.indices = indices;
+        m_meshes.push_back(std::move(mesh));
+        return static_cast<unsigned>(m_meshes.size() - 1);
+    }
+
+    // drops the last frame's occluders
+    void begin(const glm::mat4 &viewProjection) {
+        m_viewProjection = viewProjection;
+        m_occluders.clear();
+        m_queuedTriangles = 0;
+    }
+
+    // queues the front faces of the shape `mesh` placed by `model`
+    void addOccluder(const unsigned mesh, const glm::mat4 &model) {
+        m_occluders.push_back(Occluder { mesh, model, m_queuedTriangles });
+        m_queuedTriangles += m_meshes[mesh].indices.size() / 3;
+    }
+
+    // rasterizes the queued occluders into occlusion()
+    void rasterize() {
+        runBands(&SoftwareOcclusion::setupBand);
+        m_depths = m_buffer.reset(m_width, m_height, m_viewProjection);
+        m_masks.resize(static_cast<std::size_t>(m_width) * m_height);
+        m_maskDepths.resize(m_masks.size());
+        runBands(&SoftwareOcclusion::rasterizeBand);
+        m_buffer.commit();
+    }
+
+    const OcclusionBuffer &occlusion() const { return m_buffer; }
+
+    // triangles set up by the last rasterize(), i.e. not skipped
+    std::size_t triangles() const {
+        std::size_t count = 0;
+        for (const std::vector<Triangle> &setup : m_setups)
+            count += setup.size();
+        return count;
+    }
+
+    unsigned width() const { return m_width; }
+
+    unsigned height() const { return m_height; }
+
+  private:
+    // coverage samples per pixel, a 4x4 grid, and the mask of all of them
+    static const unsigned SAMPLES = 16;
+    static const unsigned FULL_MASK = 0xFFFF;
+
+    // edge functions and depth plane of a screen-space triangle, evaluated
+    // as a * x + b * y + c at pixel centers, and its pixel bounds. An edge
+    // function varies by up to edgeBias over a pixel; the depth plane is
+    // shifted to the pixel's farthest corner and capped by depthMax, the
+    // farthest vertex.
+    struct Triangle {
+        float edgeA[3], edgeB[3], edgeC[3], edgeBias[3];
+        float depthA, depthB, depthC, depthMax;
+        int x0, y0, x1, y1;
+    };
+
+    struct OccluderMesh {
+        std::vector<glm::vec3> positions;
+        std::vector<unsigned int> indices;
+    };
+
+    // a queued shape and the index of its first triangle among all queued
+    struct Occluder {
+        unsigned mesh;
+        glm::mat4 model;
+        std::size_t firstTriangle;
+    };
+
+    // pixel coordinates and window depth of a clip-space point
+    glm::vec3 screen(const glm::vec4 &clip) const {
+        const glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        return glm::vec3(
+            (0.5f * ndc.x + 0.5f) * m_width, (0.5f * ndc.y + 0.5f) * m_height,
+            0.5f * ndc.z + 0.5f);
+    }
+
+    // runs `job` on every band, the caller's included, and waits for all
+    void runBands(void (SoftwareOcclusion::*job)(unsigned)) {
+        {
+            std::lock_guard<std::mutex> lock { m_mutex };
+            m_job = job;
+            m_pending = m_workers.size();
+            m_generation++;
+        }
+        m_wake.notify_all();
+        (this->*job)(0);
+        std::unique_lock<std::mutex> lock { m_mutex };
+        m_done.wait(lock, [this] { return m_pending == 0; });
+    }
+
+    // transforms, clips and sets up the band's share of the queued
+    // triangles into m_setups[band]
+    void setupBand(const unsigned band) {
+        std::vector<Triangle> &triangles = m_setups[band];
+        triangles.clear();
+        const std::size_t bands = m_setups.size();
+        const std::size_t first = m_queuedTriangles * band / bands;
+        const std::size_t last = m_queuedTriangles * (band + 1) / bands;
+        if (first == last) return;
+        const auto startsAfter = [](const std::size_t triangle,
+                                    const Occluder &occluder) {
+            return triangle < occluder.firstTriangle;
+        };
+        // the last occluder starting at or before `first`
+        auto occluder = std::upper_bound(
+            m_occluders.begin(), m_occluders.end(), first, startsAfter);
+        --occluder;
+        for (; occluder != m_occluders.end() && occluder->firstTriangle < last;
+             ++occluder) {
+            const OccluderMesh &mesh = m_meshes[occluder->mesh];
+            const glm::mat4 transform = m_viewProjection * occluder->model;
+            const std::size_t begin =
+                std::max(first, occluder->firstTriangle) -
+                occluder->firstTriangle;
+            const std::size_t end = std::min(
+                last - occluder->firstTriangle, mesh.indices.size() / 3);
+            for (std::size_t i = begin * 3; i < end * 3; i += 3) {
+                glm::vec4 corners[3];
+                for (int corner = 0; corner < 3; corner++) {
+                    const glm::vec3 &position =
+                        mesh.positions[mesh.indices[i + corner]];
+                    corners[corner] = transform * glm::vec4(position, 1.0f);
+                }
+                // the part in front of the near plane z = -w, at most a
+                // quad
+                glm::vec4 polygon[4];
+                int count = 0;
+                for (int corner = 0; corner < 3; corner++) {
+                    const glm::vec4 &a = corners[corner];
+                    const glm::vec4 &b = corners[(corner + 1) % 3];
+                    const float da = a.z + a.w;
+                    const float db = b.z + b.w;
+                    if (da >= 0.0f) polygon[count++] = a;
+                    if ((da >= 0.0f) != (db >= 0.0f))
+                        polygon[count++] = a + (b - a) * (da / (da - db));
+                }
+                for (int corner = 1; corner + 1 < count; corner++) {
+                    setup(
+                        triangles, screen(polygon[0]), screen(polygon[corner]),
+                        screen(polygon[corner + 1]));
+                }
+            }
+        }
+    }
+
+    void setup(
+        std::vector<Triangle> &triangles, const glm::vec3 &v0,
+        const glm::vec3 &v1, const glm::vec3 &v2) {
+        const float dx1 = v1.x - v0.x;
+        const float dy1 = v1.y - v0.y;
+        const float dx2 = v2.x - v0.x;
+        const float dy2 = v2.y - v0.y;
+        const float area = dx1 * dy2 - dx2 * dy1;
+        // back faces and degenerate triangles
+        if (area <= 0.0f) return;
+
+        Triangle triangle;
+        const glm::vec3 *vertices[3] = { &v0, &v1, &v2 };
+        for (int edge = 0; edge < 3; edge++) {
+            const glm::vec3 &a = *vertices[edge];
+            const glm::vec3 &b = *vertices[(edge + 1) % 3];
+            triangle.edgeA[edge] = a.y - b.y;
+            triangle.edgeB[edge] = b.x - a.x;
+            triangle.edgeC[edge] = a.x * b.y - a.y * b.x;
+            triangle.edgeBias[edge] =
+                0.5f * (std::abs(triangle.edgeA[edge]) +
+                        std::abs(triangle.edgeB[edge]));
+        }
+        const float dz1 = v1.z - v0.z;
+        const float dz2 = v2.z - v0.z;
+        triangle.depthA = (dz1 * dy2 - dz2 * dy1) / area;
+        triangle.depthB = (dx1 * dz2 - dx2 * dz1) / area;
+        triangle.depthC =
+            v0.z - triangle.depthA * v0.x - triangle.depthB * v0.y +
+            0.5f * (std::abs(triangle.depthA) + std::abs(triangle.depthB));
+        triangle.depthMax = std::max(std::max(v0.z, v1.z), v2.z);
+
+        const float minX = std::min(std::min(v0.x, v1.x), v2.x);
+        const float maxX = std::max(std::max(v0.x, v1.x), v2.x);
+        const float minY = std::min(std::min(v0.y, v1.y), v2.y);
+        const float maxY = std::max(std::max(v0.y, v1.y), v2.y);
+        triangle.x0 = std::max(static_cast<int>(minX), 0);
+        triangle.y0 = std::max(static_cast<int>(minY), 0);
+        triangle.x1 =
+            std::min(static_cast<int>(maxX), static_cast<int>(m_width) - 1);
+        triangle.y1 =
+            std::min(static_cast<int>(maxY), static_cast<int>(m_height) - 1);
+        if (triangle.x0 > triangle.x1 || triangle.y0 > triangle.y1) return;
+        triangles.push_back(triangle);
+    }
+
+    // clears and rasterizes the rows of one band, band 0 being the caller's
+    void rasterizeBand(const unsigned band) {
+        const unsigned bands = m_workers.size() + 1;
+        const int first = static_cast<int>(m_height * band / bands);
+        const int last = static_cast<int>(m_height * (band + 1) / bands) - 1;
+        const std::size_t begin = static_cast<std::size_t>(first) * m_width;
+        const std::size_t end = static_cast<std::size_t>(last + 1) * m_width;
+        std::fill(m_depths + begin, m_depths + end, 1.0f);
+        std::fill(m_masks.begin() + begin, m_masks.begin() + end, 0);
+        std::fill(
+            m_maskDepths.begin() + begin, m_maskDepths.begin() + end, 0.0f);
+
+        for (const std::vector<Triangle> &setup : m_setups) {
+            for (const Triangle &triangle : setup)
+                rasterizeTriangle(triangle, first, last);
+        }
+    }
+
+    // rasterizes the rows `first` to `last` of a triangle
+    void rasterizeTriangle(
+        const Triangle &triangle, const int first, const int last) {
+        const simd::Float lanes = simd::lanes();
+        const simd::Float width = simd::splat(static_cast<float>(simd::WIDTH));
+        const int y0 = std::max(triangle.y0, first);
+        const int y1 = std::min(triangle.y1, last);
+        // whole SIMD words; the extra pixels fail the edge tests
+        const int x0 = triangle.x0 / simd::WIDTH * simd::WIDTH;
+
+        simd::Float stepEdge[3], bias[3], negativeBias[3];
+        for (int edge = 0; edge < 3; edge++) {
+            stepEdge[edge] =
+                simd::mul(simd::splat(triangle.edgeA[edge]), width);
+            bias[edge] = simd::splat(triangle.edgeBias[edge]);
+            negativeBias[edge] = simd::splat(-triangle.edgeBias[edge]);
+        }
+        const simd::Float stepDepth =
+            simd::mul(simd::splat(triangle.depthA), width);
+        const simd::Float depthMax = simd::splat(triangle.depthMax);
+        // how far each sample's edge functions lie from the center's
+        float samples[3][SAMPLES];
+        for (int edge = 0; edge < 3; edge++) {
+            for (unsigned sample = 0; sample < SAMPLES; sample++) {
+                samples[edge][sample] =
+                    triangle.edgeA[edge] * sampleOffset(sample % 4) +
+                    triangle.edgeB[edge] * sampleOffset(sample / 4);
+            }
+        }
+        // pixel centers of the first word of a row
+        const simd::Float px = simd::add(simd::splat(x0 + 0.5f), lanes);
+
+        for (int y = y0; y <= y1; y++) {
+            const float py = y + 0.5f;
+            simd::Float edges[3];
+            for (int edge = 0; edge < 3; edge++) {
+                edges[edge] = simd::add(
+                    simd::mul(simd::splat(triangle.edgeA[edge]), px),
+                    simd::splat(
+                        triangle.edgeB[edge] * py + triangle.edgeC[edge]));
+            }
+            simd::Float depth = simd::add(
+                simd::mul(simd::splat(triangle.depthA), px),
+                simd::splat(triangle.depthB * py + triangle.depthC));
+
+            float *row = m_depths + static_cast<std::size_t>(y) * m_width;
+            for (int x = x0; x <= triangle.x1; x += simd::WIDTH) {
+                const simd::Mask touched = simd::both(
+                    simd::both(
+                        simd::atLeast(edges[0], negativeBias[0]),
+                        simd::atLeast(edges[1], negativeBias[1])),
+                    simd::atLeast(edges[2], negativeBias[2]));
+                if (!simd::none(touched)) {
+                    const simd::Mask inside = simd::both(
+                        simd::both(
+                            simd::atLeast(edges[0], bias[0]),
+                            simd::atLeast(edges[1], bias[1])),
+                        simd::atLeast(edges[2], bias[2]));
+                    const simd::Float farthest =
+                        simd::min(depth, depthMax);
+                    const simd::Float stored = simd::load(row + x);
+                    const simd::Mask nearer = simd::less(farthest, stored);
+                    simd::store(
+                        row + x,
+                        simd::select(
+                            simd::both(inside, nearer), farthest, stored));
+                    const unsigned partial =
+                        simd::bits(simd::both(touched, nearer)) &
+                        ~simd::bits(inside);
+                    if (partial) {
+                        cover(samples, x, y, partial, edges, farthest);
+                    }
+                }
+                for (int edge = 0; edge < 3; edge++)
+                    edges[edge] = simd::add(edges[edge], stepEdge[edge]);
+                depth = simd::add(depth, stepDepth);
+            }
+        }
+    }
+
+    // position of the sample grid's column or row relative to the center
+    static float sampleOffset(const unsigned index) {
+        return (index + 0.5f) / 4.0f - 0.5f;
+    }
+
+    // adds the samples the triangle covers to the masks of the pixels in
+    // `lanes`, a bit per lane of the word at x, y; the triangle must be
+    // nearer than their depth there. A pixel whose mask fills
+    // up takes the farthest depth of the triangles that filled it.
+    void cover(
+        const float (&samples)[3][SAMPLES], const int x, const int y,
+        const unsigned lanes, const simd::Float (&edges)[3],
+        const simd::Float farthest) {
+        float edgeValues[3][simd::WIDTH];
+        float depths[simd::WIDTH];
+        for (int edge = 0; edge < 3; edge++)
+            simd::store(edgeValues[edge], edges[edge]);
+        simd::store(depths, farthest);
+
+        const std::size_t word = static_cast<std::size_t>(y) * m_width + x;
+        for (unsigned lane = 0; lane < simd::WIDTH; lane++) {
+            const std::size_t pixel = word + lane;
+            if (!(lanes >> lane & 1u)) continue;
+            unsigned mask = FULL_MASK;
+            for (int edge = 0; edge < 3; edge++) {
+                // inside where center + sample offset >= 0
+                const simd::Float threshold =
+                    simd::splat(-edgeValues[edge][lane]);
+                unsigned inside = 0;
+                for (unsigned sample = 0; sample < SAMPLES;
+                     sample += simd::WIDTH) {
+                    inside |= simd::bits(simd::atLeast(
+                                  simd::load(samples[edge] + sample),
+                                  threshold))
+                              << sample;
+                }
+                mask &= inside;
+            }
+            if (!mask) continue;
+            m_masks[pixel] |= mask;
+            m_maskDepths[pixel] = std::max(m_maskDepths[pixel], depths[lane]);
+            if (m_masks[pixel] == FULL_MASK) {
+                m_depths[pixel] =
+                    std::min(m_depths[pixel], m_maskDepths[pixel]);
+                m_masks[pixel] = 0;
+                m_maskDepths[pixel] = 0.0f;
+            }
+        }
+    }
+
+    // worker loop: one band per runBands() until destruction
+    void work(const unsigned band) {
+        unsigned generation = 0;
+        for (;;) {
+            void (SoftwareOcclusion::*job)(unsigned);
+            {
+                std::unique_lock<std::mutex> lock { m_mutex };
+                m_wake.wait(lock, [this, generation] {
+                    return m_quit || m_generation != generation;
+                });
+                if (m_quit) return;
+                generation = m_generation;
+                job = m_job;
+            }
+            (this->*job)(band);
+            std::lock_guard<std::mutex> lock { m_mutex };
+            if (--m_pending == 0) m_done.notify_one();
+        }
+    }
+
+    unsigned m_width { 0u };
+    unsigned m_height { 0u };
+    glm::mat4 m_viewProjection { 1.0f };
+    std::vector<OccluderMesh> m_meshes;
+    std::vector<Occluder> m_occluders;
+    std::size_t m_queuedTriangles { 0u };
+    // triangles set up by each band
+    std::vector<std::vector<Triangle>> m_setups;
+    OcclusionBuffer m_buffer;
+    float *m_depths { nullptr };
+    // samples covered by partly covering triangles nearer than m_depths,
+    // and the farthest depth among them
+    std::vector<std::uint16_t> m_masks;
+    std::vector<float> m_maskDepths;
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    void (SoftwareOcclusion::*m_job)(unsigned) { nullptr };
+    unsigned m_generation { 0u };
+    std::size_t m_pending { 0u };
+    bool m_quit { false };
+};
+
+#endif // SOFTWARE_OCCLUSION_H
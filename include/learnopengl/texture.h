@@ -3,13 +3,15 @@
 
 #include <glad/glad.h>
 
+#include <learnopengl/gl_state.h>
+
 class AbstractTexture {
 
   public:
     explicit AbstractTexture(const GLuint target)
         : m_target { target } {
         glGenTextures(1, &m_texture);
-        glBindTexture(m_target, m_texture);
+        bind();
     }
 
     void set(GLenum param, GLint value) {
@@ -17,11 +19,10 @@ class AbstractTexture {
         glTexParameteri(m_target, param, value);
     }
 
-    void bind() const { glBindTexture(m_target, m_texture); }
+    void bind() const { GLState::get().bindTexture(m_target, m_texture); }
 
     void activate(unsigned location) const {
-        glActiveTexture(GL_TEXTURE0 + location);
-        bind();
+        GLState::get().bindTexture(location, m_target, m_texture);
     }
 
   protected:
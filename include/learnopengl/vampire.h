@@ -1,7 +1,9 @@
 #ifndef VAMPIRE_H
 #define VAMPIRE_H
 
+#include <learnopengl/frustum.h>
 #include <learnopengl/model.h>
+#include <learnopengl/render_queue.h>
 #include <learnopengl/shader.h>
 
 #include <deque>
@@ -18,7 +20,8 @@ class Vampire {
         m_garlicModel.SetShaderTextureNamePrefix("material.");
     }
 
-    void draw(Shader &shader, const float frameTime, const float delta) {
+    // advances the vampire and drops expired garlic; once per frame
+    void update(const float frameTime, const float delta) {
         switch (m_state) {
             case APPROACHING:
                 handleApproaching(delta);
@@ -37,15 +40,19 @@ class Vampire {
             m_garlicModelMatrix.pop_front();
             m_garlicTime.pop_front();
         }
+    }
 
+    // queues the vampire and the garlic thrown at it
+    void submit(
+        RenderQueue &queue, const RenderPass pass, Shader &shader,
+        Frustum &frustum, const DrawBucket bucket = DrawBucket::All) {
         for (const auto &modelMatrix : m_garlicModelMatrix) {
-            shader.uniform("model", modelMatrix);
-            m_garlicModel.Draw(shader);
+            m_garlicModel.Submit(
+                queue, pass, shader, frustum, modelMatrix, bucket);
         }
 
-        shader.uniform("material.shininess", 4.0f);
-        shader.uniform("model", m_vampireModelMatrix);
-        m_vampireModel.Draw(shader);
+        m_vampireModel.Submit(
+            queue, pass, shader, frustum, m_vampireModelMatrix, bucket);
     }
 
     void attack(
@@ -0,0 +1,27 @@
+#version 330 core
+out float AdaptedLuminance;
+
+in vec2 TexCoords;
+
+// mipmapped log luminance of the current frame
+uniform sampler2D logLuminance;
+uniform float lastLevel;
+// adapted luminance of the previous frame (1x1)
+uniform sampler2D previousLuminance;
+uniform float deltaTime;
+// adaptation rate, higher is faster
+uniform float adaptationSpeed;
+// range the eye adapts within, keeps dark scenes from being blown up
+uniform float minLuminance;
+uniform float maxLuminance;
+
+// moves the adapted luminance towards the log-average luminance of the
+// frame exponentially over time, like an eye getting used to the light
+void main()
+{
+    float target = clamp(exp(textureLod(logLuminance, vec2(0.5), lastLevel).r),
+                         minLuminance, maxLuminance);
+    float previous = texelFetch(previousLuminance, ivec2(0), 0).r;
+    AdaptedLuminance =
+        previous + (target - previous) * (1.0 - exp(-deltaTime * adaptationSpeed));
+}
\ No newline at end of file
@@ -4,19 +4,30 @@ out vec4 FragColor;
 in vec2 TexCoords;
 
 uniform sampler2D scene;
+// bloomBlur and bloomStrength are only used with BLOOM defined
 uniform sampler2D bloomBlur;
-uniform bool bloom;
+// evens out the brightness of the bloom modes
+uniform float bloomStrength;
 uniform float exposure;
+// with auto exposure, exposure is a compensation factor on top of the
+// exposure that maps the adapted luminance to middle grey
+uniform bool autoExposure;
+uniform sampler2D adaptedLuminance;
+uniform float keyValue;
 
 void main()
 {
     const float gamma = 2.2;
     vec3 hdrColor = texture(scene, TexCoords).rgb;
+#ifdef BLOOM
     vec3 bloomColor = texture(bloomBlur, TexCoords).rgb;
-    if(bloom)
-        hdrColor += bloomColor; // additive blending
+    hdrColor += bloomColor * bloomStrength; // additive blending
+#endif
+    float sceneExposure = exposure;
+    if(autoExposure)
+        sceneExposure *= keyValue / max(texelFetch(adaptedLuminance, ivec2(0), 0).r, 1e-4);
     // tone mapping
-    vec3 result = vec3(1.0) - exp(-hdrColor * exposure);
+    vec3 result = vec3(1.0) - exp(-hdrColor * sceneExposure);
     // also gamma correct while we're at it
     result = pow(result, vec3(1.0 / gamma));
     FragColor = vec4(result, 1.0);
@@ -0,0 +1,20 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+// next larger level of the bloom mip chain (or the bright-pass buffer)
+uniform sampler2D source;
+
+// dual-filter (Kawase) downsample: the center and four diagonal taps each
+// land between texels, so bilinear filtering averages 4 texels per tap
+void main()
+{
+    vec2 texel = 1.0 / textureSize(source, 0);
+    vec3 result = texture(source, TexCoords).rgb * 4.0;
+    result += texture(source, TexCoords + vec2(-texel.x, -texel.y)).rgb;
+    result += texture(source, TexCoords + vec2( texel.x, -texel.y)).rgb;
+    result += texture(source, TexCoords + vec2(-texel.x,  texel.y)).rgb;
+    result += texture(source, TexCoords + vec2( texel.x,  texel.y)).rgb;
+    FragColor = vec4(result / 8.0, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,25 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+// next smaller level of the bloom mip chain
+uniform sampler2D source;
+// tap distance in source texels
+uniform float filterRadius;
+
+// 3x3 tent filter; the result is added onto the target level by blending
+void main()
+{
+    vec2 d = filterRadius / textureSize(source, 0);
+    vec3 result = texture(source, TexCoords).rgb * 4.0;
+    result += (texture(source, TexCoords + vec2(-d.x, 0.0)).rgb +
+               texture(source, TexCoords + vec2( d.x, 0.0)).rgb +
+               texture(source, TexCoords + vec2(0.0, -d.y)).rgb +
+               texture(source, TexCoords + vec2(0.0,  d.y)).rgb) * 2.0;
+    result += texture(source, TexCoords + vec2(-d.x, -d.y)).rgb;
+    result += texture(source, TexCoords + vec2( d.x, -d.y)).rgb;
+    result += texture(source, TexCoords + vec2(-d.x,  d.y)).rgb;
+    result += texture(source, TexCoords + vec2( d.x,  d.y)).rgb;
+    FragColor = vec4(result / 16.0, 1.0);
+}
\ No newline at end of file
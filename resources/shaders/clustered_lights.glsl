@@ -0,0 +1,42 @@
+// storage buffers of the clustered lighting path (GL 4.3), written by
+// cull_lights.comp, cluster_lights.comp and cluster_offsets.comp and read
+// by deferred_shading_clustered.frag
+
+#include "light_params.glsl"
+
+// lights owned by LightManager; with gpuLightMotion the positions are the
+// orbits' base positions, see lightPosition()
+layout (std430, binding = 0) readonly buffer LightPositions {
+    vec4 lightPositions[]; // xyz: world position, w: radius of influence
+};
+
+layout (std430, binding = 4) readonly buffer LightParams {
+    GpuLightParams lightParams[];
+};
+
+// (offset, count) into lightIndices for every cluster
+layout (std430, binding = 1) buffer Clusters {
+    uvec2 clusters[];
+};
+
+layout (std430, binding = 2) buffer LightIndices {
+    uint lightIndices[];
+};
+
+// a light that can touch the view frustum
+struct VisibleLight {
+    vec4 sphere; // view-space center, radius
+    uint index;  // into LightManager's buffers
+};
+
+layout (std430, binding = 3) buffer VisibleLights {
+    // indices all clusters asked for, lightIndices may hold fewer
+    uint lightIndexCount;
+    uint visibleLightCount;
+    VisibleLight visibleLights[];
+};
+
+uniform uvec3 clusterGrid;
+// slice = log(viewDepth) * sliceScale + sliceBias
+uniform float sliceScale;
+uniform float sliceBias;
\ No newline at end of file
@@ -1,148 +1,66 @@
 #version 330 core
+#extension GL_GOOGLE_include_directive : enable
 layout (location = 0) out vec4 FragColor;
 layout (location = 1) out vec4 BrightColor;
 
-struct DirLight {
-    vec3 direction;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-
-struct PointLight {
-    vec3 position;
-
-    vec3 specular;
-    vec3 diffuse;
-    vec3 ambient;
-
-    float constant;
-    float linear;
-    float quadratic;
-
-    float radius;
-};
-
-struct SpotLight {
-    vec3 position;
-    vec3 direction;
-    float cutOff;
-    float outerCutOff;
-
-    float constant;
-    float linear;
-    float quadratic;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
+#include "lighting.glsl"
 
 in vec2 TexCoords;
 in vec3 Normal;
 in vec3 FragPos;
 
-uniform float shininess;
-
-uniform sampler2D gPosition;
-uniform sampler2D gNormal;
-uniform sampler2D gAlbedoSpec;
-
-uniform DirLight dirLight;
-uniform PointLight pointLight;
-uniform SpotLight spotLight;
+#include "g_buffer.glsl"
+#include "magic_lights.glsl"
 
-const int NR_LIGHTS = 100;
-uniform PointLight magicLights[NR_LIGHTS];
+// tiled lighting: (offset, count) into lightIndices for every screen tile
+uniform bool tiledLighting;
+uniform int tileSize;
+uniform usampler2D lightTiles;
+uniform usamplerBuffer lightIndices;
 
-uniform vec3 viewPosition;
-uniform bool flashlight;
-
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 Diffuse, float Specular)
-{
-    vec3 lightDir = normalize(light.position - fragPos);
-    // diffuse shading
-    float diff = max(dot(normal, lightDir), 0.0);
-    // specular shading
-    vec3 halfwayDir = normalize(lightDir + viewDir);
-    float spec = pow(max(dot(normal, halfwayDir), 0.0), shininess);
-    // attenuation
-    float distance = length(light.position - fragPos);
-    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
-    // combine results
-    vec3 ambient = light.ambient * Diffuse;
-    vec3 diffuse = light.diffuse * diff * Diffuse;
-    vec3 specular = light.specular * spec * Specular;
-    ambient *= attenuation;
-    diffuse *= attenuation;
-    specular *= attenuation;
-    return ambient + diffuse + specular;
-}
-
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec3 Diffuse, float Specular)
-{
-    vec3 lightDir = normalize(-light.direction);
-    // diffuse shading
-    float diff = max(dot(normal, lightDir), 0.0);
-    // specular shading
-    vec3 halfwayDir = normalize(lightDir + viewDir);
-    float spec = pow(max(dot(normal, halfwayDir), 0.0), shininess);
-    // combine results
-    vec3 ambient = light.ambient * Diffuse;
-    vec3 diffuse = light.diffuse * diff * Diffuse;
-    vec3 specular = light.specular * spec * Specular;
-    return ambient + diffuse + specular;
-}
-
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 Diffuse, float Specular)
-{
-    vec3 lightDir = normalize(light.position - fragPos);
-    // diffuse shading
-    float diff = max(dot(normal, lightDir), 0.0);
-    // specular shading
-    vec3 halfwayDir = normalize(lightDir + viewDir);
-    float spec = pow(max(dot(normal, halfwayDir), 0.0), shininess);
-    // attenuation
-    float distance = length(light.position - fragPos);
-    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
-    // spotlight intensity
-    float theta = dot(lightDir, normalize(-light.direction));
-    float epsilon = light.cutOff - light.outerCutOff;
-    float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
-    // combine results
-    vec3 ambient = light.ambient * Diffuse;
-    vec3 diffuse = light.diffuse * diff * Diffuse;
-    vec3 specular = light.specular * spec * Specular;
-    ambient *= attenuation * intensity;
-    diffuse *= attenuation * intensity;
-    specular *= attenuation * intensity;
-    return ambient + diffuse + specular;
-}
+// light volume lighting: the magic lights are blended on afterwards
+uniform bool lightVolumes;
 
 void main()
 {
-    vec3 FragPos = texture(gPosition, TexCoords).rgb;
-    vec3 Normal = texture(gNormal, TexCoords).rgb;
+    vec3 FragPos = gBufferPosition(TexCoords);
+    vec3 normal = gBufferNormal(TexCoords);
     vec3 Diffuse = texture(gAlbedoSpec, TexCoords).rgb;
     float Specular = texture(gAlbedoSpec, TexCoords).a;
 
-    vec3 normal = normalize(Normal);
-    vec3 viewDir = normalize(viewPosition - FragPos);
+    vec3 viewDir = normalize(frame.viewPosition.xyz - FragPos);
 
-    vec3 result = CalcDirLight(dirLight, normal, viewDir, Diffuse, Specular);
-    result += CalcPointLight(pointLight, normal, FragPos, viewDir, Diffuse, Specular);
-    if (flashlight) {
-        result += CalcSpotLight(spotLight, normal, FragPos, viewDir, Diffuse, Specular);
-    }
+    vec3 result = CalcDirLight(frameDirLight(), normal, viewDir, Diffuse, Specular);
+    result += CalcPointLight(framePointLight(), normal, FragPos, viewDir, Diffuse, Specular);
+#ifdef FLASHLIGHT
+    result += CalcSpotLight(frameSpotLight(), normal, FragPos, viewDir, Diffuse, Specular);
+#endif
 
-    for(int i = 0; i < NR_LIGHTS; ++i)
-    {
-        // calculate distance between light source and current fragment
-        float distance = length(magicLights[i].position - FragPos);
-        if(distance < magicLights[i].radius)
+    if (lightVolumes) {
+        // one light_volume.frag draw per light covering this pixel
+    } else if (tiledLighting) {
+        // only the lights assigned to this pixel's tile
+        uvec2 tile = texelFetch(lightTiles, ivec2(gl_FragCoord.xy) / tileSize, 0).rg;
+        for(uint j = 0u; j < tile.y; ++j)
+        {
+            int i = int(texelFetch(lightIndices, int(tile.x + j)).r);
+            PointLight light = toPointLight(magicLightPositions[i], magicLightParams[i]);
+            float distance = length(light.position - FragPos);
+            if(distance < light.radius)
+            {
+                result += CalcPointLight(light, normal, FragPos, viewDir, Diffuse, Specular);
+            }
+        }
+    } else {
+        for(int i = 0; i < NR_LIGHTS; ++i)
         {
-            result += CalcPointLight(magicLights[i], normal, FragPos, viewDir, Diffuse, Specular);
+            PointLight light = toPointLight(magicLightPositions[i], magicLightParams[i]);
+            // calculate distance between light source and current fragment
+            float distance = length(light.position - FragPos);
+            if(distance < light.radius)
+            {
+                result += CalcPointLight(light, normal, FragPos, viewDir, Diffuse, Specular);
+            }
         }
     }
 
@@ -0,0 +1,55 @@
+#version 430 core
+#extension GL_GOOGLE_include_directive : enable
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out vec4 BrightColor;
+
+#include "lighting.glsl"
+
+in vec2 TexCoords;
+in vec3 Normal;
+in vec3 FragPos;
+
+#include "g_buffer.glsl"
+
+#include "clustered_lights.glsl"
+
+uniform vec2 viewportSize;
+
+void main()
+{
+    vec3 FragPos = gBufferPosition(TexCoords);
+    vec3 normal = gBufferNormal(TexCoords);
+    vec3 Diffuse = texture(gAlbedoSpec, TexCoords).rgb;
+    float Specular = texture(gAlbedoSpec, TexCoords).a;
+
+    vec3 viewDir = normalize(frame.viewPosition.xyz - FragPos);
+
+    vec3 result = CalcDirLight(frameDirLight(), normal, viewDir, Diffuse, Specular);
+    result += CalcPointLight(framePointLight(), normal, FragPos, viewDir, Diffuse, Specular);
+#ifdef FLASHLIGHT
+    result += CalcSpotLight(frameSpotLight(), normal, FragPos, viewDir, Diffuse, Specular);
+#endif
+
+    // only the lights assigned to this fragment's cluster
+    float depth = max(-(frame.view * vec4(FragPos, 1.0)).z, 1e-3);
+    uint slice = uint(clamp(log(depth) * sliceScale + sliceBias, 0.0, float(clusterGrid.z - 1u)));
+    uvec2 tile = min(uvec2(gl_FragCoord.xy / (viewportSize / vec2(clusterGrid.xy))), clusterGrid.xy - 1u);
+    uvec2 cluster = clusters[tile.x + clusterGrid.x * (tile.y + clusterGrid.y * slice)];
+    for(uint j = 0u; j < cluster.y; ++j)
+    {
+        uint i = lightIndices[cluster.x + j];
+        PointLight light = toPointLight(lightPositions[i], lightParams[i]);
+        float distance = length(light.position - FragPos);
+        if(distance < light.radius)
+        {
+            result += CalcPointLight(light, normal, FragPos, viewDir, Diffuse, Specular);
+        }
+    }
+
+    FragColor = vec4(result, 1.0);
+    float brightness = dot(FragColor.rgb, vec3(0.2126, 0.7152, 0.0722));
+    if(brightness > 1.0)
+        BrightColor = vec4(FragColor.rgb, 1.0);
+    else
+        BrightColor = vec4(0.0, 0.0, 0.0, 1.0);
+}
\ No newline at end of file
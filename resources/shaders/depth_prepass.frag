@@ -0,0 +1,21 @@
+#version 330 core
+// depth only; the color attachments are masked during the pre-pass
+
+#ifdef ALPHA_TEST
+struct Material {
+    sampler2D texture_diffuse1;
+};
+
+in vec2 TexCoords;
+
+uniform Material material;
+#endif
+
+void main()
+{
+#ifdef ALPHA_TEST
+    // same cut-out as the ALPHA_TEST geometry pass
+    if (texture(material.texture_diffuse1, TexCoords).a < 0.1)
+        discard;
+#endif
+}
\ No newline at end of file
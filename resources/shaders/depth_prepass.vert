@@ -0,0 +1,37 @@
+#version 330 core
+#extension GL_GOOGLE_include_directive : enable
+layout (location = 0) in vec3 aPos;
+#ifdef ALPHA_TEST
+layout (location = 2) in vec2 aTexCoords;
+#endif
+#ifdef INSTANCED
+layout (location = 5) in mat4 aInstanceModel;
+#endif
+
+#ifdef ALPHA_TEST
+out vec2 TexCoords;
+#endif
+
+#include "frame_constants.glsl"
+
+#ifndef INSTANCED
+uniform mat4 model;
+#endif
+
+// the geometry pass tests against this depth with GL_EQUAL, so both have to
+// compute gl_Position the same way
+invariant gl_Position;
+
+void main()
+{
+#ifdef INSTANCED
+    vec4 worldPos = aInstanceModel * vec4(aPos, 1.0);
+#else
+    vec4 worldPos = model * vec4(aPos, 1.0);
+#endif
+#ifdef ALPHA_TEST
+    TexCoords = aTexCoords;
+#endif
+
+    gl_Position = frame.projection * frame.view * worldPos;
+}
\ No newline at end of file
@@ -0,0 +1,22 @@
+#version 330 core
+out float Depth;
+
+// next larger pyramid level, clamped to its own mip level, or the depth
+// buffer for level 0
+uniform sampler2D source;
+
+// farthest depth of the 2x2 source texels under this texel; the last texel
+// of a row or column also takes the odd one left over by an odd size
+void main()
+{
+    ivec2 size = textureSize(source, 0);
+    ivec2 first = ivec2(gl_FragCoord.xy) * 2;
+    ivec2 last = min(first + 1 + ivec2(equal(first + 3, size)), size - 1);
+    float depth = 0.0;
+    for (int y = first.y; y <= last.y; y++) {
+        for (int x = first.x; x <= last.x; x++) {
+            depth = max(depth, texelFetch(source, ivec2(x, y), 0).r);
+        }
+    }
+    Depth = depth;
+}
\ No newline at end of file
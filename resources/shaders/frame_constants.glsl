@@ -0,0 +1,35 @@
+// per-frame constants shared by every program (FrameConstants in
+// frame_constants.h). Everything is a mat4 or vec4 so that the std140
+// layout matches the C++ struct without padding rules.
+#ifndef FRAME_CONSTANTS_GLSL
+#define FRAME_CONSTANTS_GLSL
+
+layout (std140) uniform FrameConstants {
+    mat4 projection;
+    mat4 view;
+    mat4 inverseProjection;
+    mat4 inverseView;
+    vec4 viewPosition;
+    vec4 viewDirection;
+    vec4 time; // x: seconds since start, y: duration of the last frame
+
+    vec4 dirLightDirection;
+    vec4 dirLightAmbient;
+    vec4 dirLightDiffuse;
+    vec4 dirLightSpecular;
+
+    vec4 pointLightPosition; // w: radius
+    vec4 pointLightAmbient;
+    vec4 pointLightDiffuse;
+    vec4 pointLightSpecular;
+    vec4 pointLightAttenuation; // constant, linear, quadratic
+
+    // the flashlight sits at viewPosition and points along viewDirection
+    vec4 spotLightAmbient;
+    vec4 spotLightDiffuse;
+    vec4 spotLightSpecular;
+    vec4 spotLightAttenuation; // constant, linear, quadratic
+    vec4 spotLightCutOff; // inner and outer cosine
+} frame;
+
+#endif
\ No newline at end of file
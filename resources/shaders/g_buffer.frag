@@ -1,4 +1,5 @@
 #version 330 core
+#extension GL_GOOGLE_include_directive : enable
 layout (location = 0) out vec3 gPosition;
 layout (location = 1) out vec3 gNormal;
 layout (location = 2) out vec4 gAlbedoSpec;
@@ -8,6 +9,8 @@ struct Material {
     sampler2D texture_specular1;
 };
 
+#include "octahedral.glsl"
+
 in vec2 TexCoords;
 in vec3 FragPos;
 in vec3 Normal;
@@ -17,14 +20,18 @@ uniform Material material;
 void main()
 {
     // store the fragment position vector in the first gbuffer texture
+    // (not attached in the compact layout, which reconstructs it from depth)
     gPosition = FragPos;
     // also store the per-fragment normals into the gbuffer
-    gNormal = normalize(Normal);
+    gNormal = vec3(octEncode(normalize(Normal)), 0.0);
     // and the diffuse per-fragment color
     vec4 albedo = texture(material.texture_diffuse1, TexCoords);
-    // blending
+#ifdef ALPHA_TEST
+    // cut-out materials only; a discard anywhere in the shader turns off
+    // early depth testing for everything drawn with it
     if (albedo.a < 0.1)
         discard;
+#endif
     gAlbedoSpec.rgb = albedo.rgb;
     
     // store specular intensity in gAlbedoSpec's alpha component
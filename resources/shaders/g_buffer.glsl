@@ -0,0 +1,28 @@
+// G-buffer access for the lighting passes. The classic layout stores the
+// world position in gPosition; the compact one drops it and reconstructs
+// the position from gDepth. Normals are octahedral-encoded in both.
+
+#include "frame_constants.glsl"
+#include "octahedral.glsl"
+
+uniform sampler2D gPosition;
+uniform sampler2D gNormal;
+uniform sampler2D gAlbedoSpec;
+uniform sampler2D gDepth;
+
+uniform bool compactGBuffer;
+
+vec3 gBufferPosition(vec2 uv)
+{
+    if (!compactGBuffer)
+        return texture(gPosition, uv).rgb;
+
+    float depth = texture(gDepth, uv).r;
+    vec4 viewPos = frame.inverseProjection * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+    return (frame.inverseView * vec4(viewPos.xyz / viewPos.w, 1.0)).xyz;
+}
+
+vec3 gBufferNormal(vec2 uv)
+{
+    return octDecode(texture(gNormal, uv).rg);
+}
\ No newline at end of file
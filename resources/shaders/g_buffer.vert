@@ -1,4 +1,5 @@
 #version 330 core
+#extension GL_GOOGLE_include_directive : enable
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
@@ -7,9 +8,12 @@ out vec3 FragPos;
 out vec2 TexCoords;
 out vec3 Normal;
 
+#include "frame_constants.glsl"
+
+// matches depth_prepass.vert for the GL_EQUAL depth test after the pre-pass
+invariant gl_Position;
+
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
 
 void main()
 {
@@ -20,5 +24,5 @@ void main()
     mat3 normalMatrix = transpose(inverse(mat3(model)));
     Normal = normalMatrix * aNormal;
 
-    gl_Position = projection * view * worldPos;
+    gl_Position = frame.projection * frame.view * worldPos;
 }
\ No newline at end of file
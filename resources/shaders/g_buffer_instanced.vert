@@ -0,0 +1,27 @@
+#version 330 core
+#extension GL_GOOGLE_include_directive : enable
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 5) in mat4 aInstanceModel;
+
+out vec3 FragPos;
+out vec2 TexCoords;
+out vec3 Normal;
+
+#include "frame_constants.glsl"
+
+// matches depth_prepass.vert for the GL_EQUAL depth test after the pre-pass
+invariant gl_Position;
+
+void main()
+{
+    vec4 worldPos = aInstanceModel * vec4(aPos, 1.0);
+    FragPos = worldPos.xyz;
+    TexCoords = aTexCoords;
+
+    mat3 normalMatrix = transpose(inverse(mat3(aInstanceModel)));
+    Normal = normalMatrix * aNormal;
+
+    gl_Position = frame.projection * frame.view * worldPos;
+}
\ No newline at end of file
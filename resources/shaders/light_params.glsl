@@ -0,0 +1,31 @@
+// per-light data of the light buffers, shared by lighting.glsl and
+// clustered_lights.glsl; guarded since a shader may include both
+#ifndef LIGHT_PARAMS_GLSL
+#define LIGHT_PARAMS_GLSL
+
+#include "frame_constants.glsl"
+
+// static part of a light in the light buffers (GpuLightParams in
+// light_manager.h); the position and radius are stored separately
+struct GpuLightParams {
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+    vec4 attenuation; // constant, linear, quadratic, angular speed
+};
+
+// with gpuLightMotion the light buffers hold base positions and every light
+// orbits around it as MagicLight::nextFrame() does on the CPU
+uniform bool gpuLightMotion;
+
+const float ORBIT_RADIUS = 4.0;
+
+vec3 lightPosition(vec4 positionRadius, GpuLightParams params)
+{
+    if (!gpuLightMotion)
+        return positionRadius.xyz;
+    float angle = params.attenuation.w * frame.time.x;
+    return positionRadius.xyz + vec3(ORBIT_RADIUS * cos(angle), ORBIT_RADIUS, ORBIT_RADIUS * sin(angle));
+}
+
+#endif
\ No newline at end of file
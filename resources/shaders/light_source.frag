@@ -10,7 +10,6 @@ struct Material {
 in vec2 TexCoords;
 
 uniform Material material;
-uniform bool allBright;
 uniform float intensity;
 
 void main()
@@ -18,8 +17,8 @@ void main()
     FragColor = texture(material.texture_diffuse1, TexCoords) * intensity;
     float brightness = dot(FragColor.rgb, vec3(0.2126, 0.7152, 0.0722));
     BrightColor = vec4(FragColor.rgb, 1.0);
-    if(allBright || brightness > 1.0)
-        BrightColor = vec4(FragColor.rgb, 1.0);
-    else
+#ifndef ALL_BRIGHT
+    if(brightness <= 1.0)
         BrightColor = vec4(0.0, 0.0, 0.0, 1.0);
+#endif
 }
\ No newline at end of file
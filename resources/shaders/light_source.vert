@@ -1,16 +1,24 @@
 #version 330 core
+#extension GL_GOOGLE_include_directive : enable
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+#ifdef INSTANCED
+layout (location = 5) in mat4 aInstanceModel;
+#endif
 
 out vec2 TexCoords;
 
+#include "frame_constants.glsl"
+
+#ifdef INSTANCED
+#define model aInstanceModel
+#else
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#endif
 
 void main()
 {
     TexCoords = aTexCoords;
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = frame.projection * frame.view * model * vec4(aPos, 1.0);
 }
\ No newline at end of file
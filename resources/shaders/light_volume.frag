@@ -0,0 +1,37 @@
+#version 330 core
+#extension GL_GOOGLE_include_directive : enable
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out vec4 BrightColor;
+
+#include "lighting.glsl"
+#include "g_buffer.glsl"
+#include "magic_lights.glsl"
+
+uniform int light;
+
+void main()
+{
+    vec2 TexCoords = gl_FragCoord.xy / vec2(textureSize(gDepth, 0));
+    vec3 FragPos = gBufferPosition(TexCoords);
+    vec3 normal = gBufferNormal(TexCoords);
+    vec3 Diffuse = texture(gAlbedoSpec, TexCoords).rgb;
+    float Specular = texture(gAlbedoSpec, TexCoords).a;
+
+    vec3 viewDir = normalize(frame.viewPosition.xyz - FragPos);
+
+    // the stencil only bounds the polygonal sphere, the radius test is the
+    // same as in deferred_shading.frag
+    vec3 result = vec3(0.0);
+    PointLight pointLight = toPointLight(magicLightPositions[light], magicLightParams[light]);
+    if (length(pointLight.position - FragPos) < pointLight.radius)
+        result = CalcPointLight(pointLight, normal, FragPos, viewDir, Diffuse, Specular);
+
+    // added onto the full-screen pass, so the bright pass can only threshold
+    // each light's contribution on its own
+    FragColor = vec4(result, 0.0);
+    float brightness = dot(result, vec3(0.2126, 0.7152, 0.0722));
+    if(brightness > 1.0)
+        BrightColor = vec4(result, 0.0);
+    else
+        BrightColor = vec4(0.0);
+}
\ No newline at end of file
@@ -0,0 +1,17 @@
+#version 330 core
+#extension GL_GOOGLE_include_directive : enable
+layout (location = 0) in vec3 aPos;
+
+#include "magic_lights.glsl"
+
+// index into the MagicLights block
+uniform int light;
+
+void main()
+{
+    // aPos is on a sphere a bit larger than the unit sphere, so the faces
+    // never cut into the light's radius
+    vec4 positionRadius = magicLightPositions[light];
+    vec3 center = lightPosition(positionRadius, magicLightParams[light]);
+    gl_Position = frame.projection * frame.view * vec4(center + positionRadius.w * aPos, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,135 @@
+// light structs and Blinn-Phong helpers shared by the lighting passes
+
+struct DirLight {
+    vec3 direction;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct PointLight {
+    vec3 position;
+
+    vec3 specular;
+    vec3 diffuse;
+    vec3 ambient;
+
+    float constant;
+    float linear;
+    float quadratic;
+
+    float radius;
+};
+
+struct SpotLight {
+    vec3 position;
+    vec3 direction;
+    float cutOff;
+    float outerCutOff;
+
+    float constant;
+    float linear;
+    float quadratic;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+#include "frame_constants.glsl"
+#include "light_params.glsl"
+
+// scene lights of the FrameConstants block
+DirLight frameDirLight()
+{
+    return DirLight(frame.dirLightDirection.xyz,
+                    frame.dirLightAmbient.rgb, frame.dirLightDiffuse.rgb, frame.dirLightSpecular.rgb);
+}
+
+PointLight framePointLight()
+{
+    return PointLight(frame.pointLightPosition.xyz,
+                      frame.pointLightSpecular.rgb, frame.pointLightDiffuse.rgb, frame.pointLightAmbient.rgb,
+                      frame.pointLightAttenuation.x, frame.pointLightAttenuation.y, frame.pointLightAttenuation.z,
+                      frame.pointLightPosition.w);
+}
+
+SpotLight frameSpotLight()
+{
+    return SpotLight(frame.viewPosition.xyz, frame.viewDirection.xyz,
+                     frame.spotLightCutOff.x, frame.spotLightCutOff.y,
+                     frame.spotLightAttenuation.x, frame.spotLightAttenuation.y, frame.spotLightAttenuation.z,
+                     frame.spotLightAmbient.rgb, frame.spotLightDiffuse.rgb, frame.spotLightSpecular.rgb);
+}
+
+PointLight toPointLight(vec4 positionRadius, GpuLightParams params)
+{
+    return PointLight(lightPosition(positionRadius, params),
+                      params.specular.rgb, params.diffuse.rgb, params.ambient.rgb,
+                      params.attenuation.x, params.attenuation.y, params.attenuation.z,
+                      positionRadius.w);
+}
+
+uniform float shininess;
+
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 Diffuse, float Specular)
+{
+    vec3 lightDir = normalize(light.position - fragPos);
+    // diffuse shading
+    float diff = max(dot(normal, lightDir), 0.0);
+    // specular shading
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), shininess);
+    // attenuation
+    float distance = length(light.position - fragPos);
+    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+    // combine results
+    vec3 ambient = light.ambient * Diffuse;
+    vec3 diffuse = light.diffuse * diff * Diffuse;
+    vec3 specular = light.specular * spec * Specular;
+    ambient *= attenuation;
+    diffuse *= attenuation;
+    specular *= attenuation;
+    return ambient + diffuse + specular;
+}
+
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec3 Diffuse, float Specular)
+{
+    vec3 lightDir = normalize(-light.direction);
+    // diffuse shading
+    float diff = max(dot(normal, lightDir), 0.0);
+    // specular shading
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), shininess);
+    // combine results
+    vec3 ambient = light.ambient * Diffuse;
+    vec3 diffuse = light.diffuse * diff * Diffuse;
+    vec3 specular = light.specular * spec * Specular;
+    return ambient + diffuse + specular;
+}
+
+vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 Diffuse, float Specular)
+{
+    vec3 lightDir = normalize(light.position - fragPos);
+    // diffuse shading
+    float diff = max(dot(normal, lightDir), 0.0);
+    // specular shading
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), shininess);
+    // attenuation
+    float distance = length(light.position - fragPos);
+    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+    // spotlight intensity
+    float theta = dot(lightDir, normalize(-light.direction));
+    float epsilon = light.cutOff - light.outerCutOff;
+    float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
+    // combine results
+    vec3 ambient = light.ambient * Diffuse;
+    vec3 diffuse = light.diffuse * diff * Diffuse;
+    vec3 specular = light.specular * spec * Specular;
+    ambient *= attenuation * intensity;
+    diffuse *= attenuation * intensity;
+    specular *= attenuation * intensity;
+    return ambient + diffuse + specular;
+}
\ No newline at end of file
@@ -0,0 +1,15 @@
+#version 330 core
+out float LogLuminance;
+
+in vec2 TexCoords;
+
+uniform sampler2D scene;
+
+// log luminance of the HDR scene; the mip chain of the target then averages
+// it down to a single texel
+void main()
+{
+    vec3 color = texture(scene, TexCoords).rgb;
+    float luminance = dot(color, vec3(0.2126, 0.7152, 0.0722));
+    LogLuminance = log(max(luminance, 1e-4));
+}
\ No newline at end of file
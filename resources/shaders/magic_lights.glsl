@@ -0,0 +1,15 @@
+// the MagicLights uniform block, read by deferred_shading.frag and the
+// light volume shaders
+
+#include "light_params.glsl"
+
+// filled by LightManager: positions every frame (only on change with
+// gpuLightMotion), parameters on change. NR_LIGHTS is injected from
+// LightManager::UNIFORM_LIGHTS.
+#ifndef NR_LIGHTS
+#define NR_LIGHTS 100
+#endif
+layout (std140) uniform MagicLights {
+    vec4 magicLightPositions[NR_LIGHTS]; // xyz: world position, w: radius
+    GpuLightParams magicLightParams[NR_LIGHTS];
+};
\ No newline at end of file
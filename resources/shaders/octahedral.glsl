@@ -0,0 +1,24 @@
+// octahedral unit vector encoding: a normal folded onto the octahedron and
+// flattened to two [0, 1] components, so it fits an RG16 target
+
+vec2 signNotZero(vec2 v)
+{
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+vec2 octEncode(vec3 n)
+{
+    vec2 p = n.xy / (abs(n.x) + abs(n.y) + abs(n.z));
+    if (n.z < 0.0)
+        p = (1.0 - abs(p.yx)) * signNotZero(p);
+    return p * 0.5 + 0.5;
+}
+
+vec3 octDecode(vec2 e)
+{
+    vec2 p = e * 2.0 - 1.0;
+    vec3 n = vec3(p, 1.0 - abs(p.x) - abs(p.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * signNotZero(n.xy);
+    return normalize(n);
+}
\ No newline at end of file
@@ -1,14 +1,15 @@
 #version 330 core
+#extension GL_GOOGLE_include_directive : enable
 layout (location = 0) in vec3 aPos;
 
 out vec3 TexCoords;
 
-uniform mat4 projection;
-uniform mat4 view;
+#include "frame_constants.glsl"
 
 void main()
 {
     TexCoords = aPos;
-    vec4 pos = projection * view * vec4(aPos, 1.0);
+    // rotation only: the sky is infinitely far away
+    vec4 pos = frame.projection * mat4(mat3(frame.view)) * vec4(aPos, 1.0);
     gl_Position = pos.xyww;
 }
\ No newline at end of file
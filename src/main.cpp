@@ -11,18 +11,33 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include <learnopengl/camera.h>
+#include <learnopengl/gl43.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/gpu_culling.h>
+#include <learnopengl/gpu_query.h>
+#include <learnopengl/instance_buffer.h>
+#include <learnopengl/instance_grid.h>
 #include <learnopengl/model.h>
+#include <learnopengl/program_cache.h>
+#include <learnopengl/render_queue.h>
 #include <learnopengl/shader.h>
+#include <learnopengl/shader_variants.h>
+#include <learnopengl/software_occlusion.h>
 
 #include <learnopengl/cubemap.h>
+#include <learnopengl/frustum.h>
 #include <learnopengl/vampire.h>
 
 #include <learnopengl/DeferredShading.h>
+#include <learnopengl/clustered_shading.h>
+#include <learnopengl/frame_constants.h>
 #include <learnopengl/hdr.h>
-#include <learnopengl/magic_light.h>
+#include <learnopengl/light_manager.h>
 
+#include <algorithm>
 #include <iostream>
 #include <memory>
+#include <random>
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
 
@@ -43,12 +58,20 @@ void renderQuad();
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
+// the software occlusion buffer is this many times smaller than the window
+// in each direction, which keeps it well under a millisecond
+const unsigned int OCCLUSION_DOWNSCALE = 4;
 
 // camera
 float lastX = SCR_WIDTH / 2.0f;
 float lastY = SCR_HEIGHT / 2.0f;
 bool firstMouse = true;
 
+// upper bound of the magic light count, enforced each frame
+const int MAX_MAGIC_LIGHTS = 16384;
+// upper bound of the procedural forest slider
+const int MAX_FOREST_PINES = 100000;
+
 // timing
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
@@ -83,8 +106,34 @@ struct ProgramState {
     PointLight pointLight;
     DirLight dirLight;
     bool flashlight { false };
+    // magic lights in the scene; only the first LightManager::UNIFORM_LIGHTS
+    // are lit without clustered lighting
+    int magicLightCount { LightManager::UNIFORM_LIGHTS };
+    // magic light orbits evaluated in the shaders instead of on the CPU
+    bool gpuLightMotion { false };
+    // opaque meshes drawn before, and without the discard of, the
+    // alpha-tested ones
+    bool alphaTestSplit { true };
+    // pines frustum culled by a compute pass instead of on the CPU
+    bool gpuCulling { false };
+    // pines scattered around the scene on top of the hand-placed ones
+    int forestPines { 0 };
+    // boxes tested against occluders rasterized on the CPU this frame
+    // instead of against the depth pyramid
+    bool softwareOcclusion { false };
+    // terrain, barn and nearby pine trunks rasterized on the CPU
+    SoftwareOcclusion occlusionRasterizer {
+        SCR_WIDTH / OCCLUSION_DOWNSCALE, SCR_HEIGHT / OCCLUSION_DOWNSCALE
+    };
     std::unique_ptr<DeferredShading> deferredShading;
     HDR hdr { SCR_WIDTH, SCR_HEIGHT };
+    Frustum frustum;
+    // every mesh drawn in a frame goes through the queue, sorted to change
+    // as little state as possible
+    RenderQueue renderQueue;
+    // g-buffer samples written by each pass
+    GpuQuery opaqueSamples { GL_SAMPLES_PASSED };
+    GpuQuery alphaTestedSamples { GL_SAMPLES_PASSED };
 
     ProgramState()
         : camera(glm::vec3(0.0f, 0.0f, 3.0f)) {}
@@ -131,7 +180,8 @@ int main() {
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    // ask for 4.3 first for the compute paths, then fall back to 3.3
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
@@ -143,6 +193,12 @@ int main() {
     // --------------------
     GLFWwindow *window = glfwCreateWindow(
         screen.width, screen.height, "LearnOpenGL", nullptr, nullptr);
+    if (window == nullptr) {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        window = glfwCreateWindow(
+            screen.width, screen.height, "LearnOpenGL", nullptr, nullptr);
+    }
     if (window == nullptr) {
         std::cout << "Failed to create GLFW window" << std::endl;
         glfwTerminate();
@@ -163,6 +219,10 @@ int main() {
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    if (!gl43::load((GLADloadproc) glfwGetProcAddress)) {
+        std::cout << "OpenGL " << GLVersion.major << "." << GLVersion.minor
+                  << ": clustered lighting disabled" << std::endl;
+    }
 
     // tell stb_image.h to flip loaded texture's on the y-axis (before loading
     // model).
@@ -191,22 +251,104 @@ int main() {
     Shader skyboxShader(
         "resources/shaders/skybox.vert", "resources/shaders/skybox.frag");
 
-    Shader geometryPassShader(
-        "resources/shaders/g_buffer.vert", "resources/shaders/g_buffer.frag");
-    Shader lightingPassShader(
+    ShaderVariants geometryPassShader(
+        "resources/shaders/g_buffer.vert", "resources/shaders/g_buffer.frag",
+        { "ALPHA_TEST" });
+    ShaderVariants geometryPassInstancedShader(
+        "resources/shaders/g_buffer_instanced.vert",
+        "resources/shaders/g_buffer.frag", { "ALPHA_TEST" });
+    const unsigned ALPHA_TEST = geometryPassShader.feature("ALPHA_TEST");
+    // same ALPHA_TEST bit as the geometry pass
+    ShaderVariants depthPrePassShader(
+        "resources/shaders/depth_prepass.vert",
+        "resources/shaders/depth_prepass.frag", { "ALPHA_TEST", "INSTANCED" });
+    const unsigned INSTANCED = depthPrePassShader.feature("INSTANCED");
+    ShaderVariants lightingPassShader(
         "resources/shaders/deferred_shading.vert",
-        "resources/shaders/deferred_shading.frag");
-    Shader lightSourceShader(
+        "resources/shaders/deferred_shading.frag",
+        DeferredShading::lightingFeatures(),
+        { "NR_LIGHTS " + std::to_string(LightManager::UNIFORM_LIGHTS) });
+    // same INSTANCED bit as the depth pre-pass
+    ShaderVariants lightSourceShader(
         "resources/shaders/light_source.vert",
-        "resources/shaders/light_source.frag");
+        "resources/shaders/light_source.frag", { "ALL_BRIGHT", "INSTANCED" });
+    const unsigned ALL_BRIGHT = lightSourceShader.feature("ALL_BRIGHT");
 
     Shader blurShader(
         "resources/shaders/blur.vert", "resources/shaders/blur.frag");
-    Shader bloomShader(
-        "resources/shaders/bloom.vert", "resources/shaders/bloom.frag");
+    Shader bloomDownsampleShader(
+        "resources/shaders/blur.vert",
+        "resources/shaders/bloom_downsample.frag");
+    Shader bloomUpsampleShader(
+        "resources/shaders/blur.vert",
+        "resources/shaders/bloom_upsample.frag");
+    Shader luminanceShader(
+        "resources/shaders/blur.vert", "resources/shaders/luminance.frag");
+    Shader adaptExposureShader(
+        "resources/shaders/blur.vert",
+        "resources/shaders/adapt_exposure.frag");
+    ShaderVariants bloomShader(
+        "resources/shaders/bloom.vert", "resources/shaders/bloom.frag",
+        { "BLOOM" });
 
     programState->deferredShading = std::make_unique<DeferredShading>(
-        SCR_WIDTH, SCR_HEIGHT, geometryPassShader, lightingPassShader);
+        SCR_WIDTH, SCR_HEIGHT, lightingPassShader);
+    Shader depthPyramidShader(
+        "resources/shaders/blur.vert", "resources/shaders/depth_pyramid.frag");
+    DepthPyramid depthPyramid { depthPyramidShader };
+    programState->deferredShading->setDepthPyramid(&depthPyramid);
+    // magic lights as spheres; the stencil pass writes no color, like the
+    // depth pre-pass
+    const std::string lightCount =
+        "NR_LIGHTS " + std::to_string(LightManager::UNIFORM_LIGHTS);
+    Shader lightVolumeStencilShader(
+        "resources/shaders/light_volume.vert",
+        "resources/shaders/depth_prepass.frag", { lightCount });
+    Shader lightVolumeShader(
+        "resources/shaders/light_volume.vert",
+        "resources/shaders/light_volume.frag", { lightCount });
+    LightVolumes lightVolumes { lightVolumeStencilShader, lightVolumeShader };
+    programState->deferredShading->setLightVolumes(&lightVolumes);
+
+    std::unique_ptr<Shader> cullClusterLightsShader;
+    std::unique_ptr<Shader> countClusterLightsShader;
+    std::unique_ptr<Shader> clusterOffsetsShader;
+    std::unique_ptr<Shader> clusterLightsShader;
+    std::unique_ptr<ShaderVariants> clusteredLightingPassShader;
+    std::unique_ptr<ClusteredShading> clusteredShading;
+    if (gl43::supported()) {
+        cullClusterLightsShader = std::make_unique<Shader>(
+            "resources/shaders/cull_lights.comp");
+        countClusterLightsShader = std::make_unique<Shader>(
+            "resources/shaders/cluster_lights.comp",
+            std::vector<std::string> { "COUNT_LIGHTS" });
+        clusterOffsetsShader = std::make_unique<Shader>(
+            "resources/shaders/cluster_offsets.comp");
+        clusterLightsShader = std::make_unique<Shader>(
+            "resources/shaders/cluster_lights.comp");
+        clusteredLightingPassShader = std::make_unique<ShaderVariants>(
+            "resources/shaders/deferred_shading.vert",
+            "resources/shaders/deferred_shading_clustered.frag",
+            DeferredShading::lightingFeatures());
+        clusteredShading = std::make_unique<ClusteredShading>(
+            *cullClusterLightsShader, *countClusterLightsShader,
+            *clusterOffsetsShader, *clusterLightsShader,
+            *clusteredLightingPassShader);
+        programState->deferredShading->setClusteredShading(
+            clusteredShading.get());
+    }
+
+    const ProgramCache::Stats &programStats = ProgramCache::get().stats();
+    std::cout << "Shader programs: " << programStats.hits << " cached, "
+              << programStats.misses << " compiled in "
+              << programStats.milliseconds << " ms"
+              << (ProgramCache::get().enabled()
+                      ? ""
+                      : " (program binaries not supported)")
+              << std::endl;
+
+    // camera and scene lights of every program, uploaded once per frame
+    FrameConstants frameConstants;
 
     // load models
     // -----------
@@ -247,16 +389,14 @@ int main() {
     dirLight.diffuse = glm::vec3(0.05, 0.05, 0.05);
     dirLight.specular = glm::vec3(0.05, 0.05, 0.05);
 
-    lightingPassShader.uniform("spotLight.ambient", 0.0f, 0.0f, 0.0f);
-    lightingPassShader.uniform("spotLight.diffuse", 1.0f, 1.0f, 1.0f);
-    lightingPassShader.uniform("spotLight.specular", 1.0f, 1.0f, 1.0f);
-    lightingPassShader.uniform("spotLight.constant", 1.0f);
-    lightingPassShader.uniform("spotLight.linear", 0.048f);
-    lightingPassShader.uniform("spotLight.quadratic", 0.0042f);
-    lightingPassShader.uniform(
-        "spotLight.cutOff", glm::cos(glm::radians(12.5f)));
-    lightingPassShader.uniform(
-        "spotLight.outerCutOff", glm::cos(glm::radians(15.0f)));
+    FrameConstants::Data &frameData = frameConstants.data();
+    frameData.spotLightAmbient = glm::vec4(0.0f);
+    frameData.spotLightDiffuse = glm::vec4(1.0f);
+    frameData.spotLightSpecular = glm::vec4(1.0f);
+    frameData.spotLightAttenuation = glm::vec4(1.0f, 0.048f, 0.0042f, 0.0f);
+    frameData.spotLightCutOff = glm::vec4(
+        glm::cos(glm::radians(12.5f)), glm::cos(glm::radians(15.0f)), 0.0f,
+        0.0f);
 
     // fixed height for FPS camera
     programState->camera.Position.y = 5.5f;
@@ -304,6 +444,67 @@ int main() {
         model = glm::scale(model, glm::vec3(pineScales[i]));
         pineModels.push_back(model);
     }
+    const std::size_t placedPines = pineModels.size();
+    // pines by position in chunks of the forest, with their world-space
+    // boxes, for culling whole chunks and picking the pines near the camera
+    InstanceGrid pineGrid { 20.0f };
+    // adds or drops procedural pines, always the same ones for a given count
+    const auto growForest = [&](const std::size_t count) {
+        pineModels.resize(placedPines);
+        std::mt19937 random { 1u };
+        std::uniform_real_distribution<float> coordinate { -190.0f, 190.0f };
+        std::uniform_real_distribution<float> scale { 1.2f, 6.0f };
+        while (pineModels.size() < placedPines + count) {
+            const glm::vec3 position { coordinate(random), 1.5f,
+                                       coordinate(random) };
+            glm::mat4 model = glm::translate(glm::mat4(1.0f), position);
+            model = glm::scale(model, glm::vec3(scale(random)));
+            pineModels.push_back(model);
+        }
+        pineGrid.build(pineModels, pine.bounds());
+    };
+    growForest(programState->forestPines);
+    std::size_t forestPines = programState->forestPines;
+    InstanceBuffer pineInstances { pineModels };
+    // pines inside the frustum, found every frame; pineInstances is only
+    // refilled when they differ from the uploaded ones
+    std::vector<unsigned> visiblePines;
+    std::vector<unsigned> uploadedPines;
+    bool pineInstancesStale { true };
+    std::vector<glm::mat4> visiblePineModels;
+
+    // the opaque meshes of the occluding models, handed to the rasterizer
+    // once; each frame only places them
+    SoftwareOcclusion &occlusionRasterizer = programState->occlusionRasterizer;
+    const float OCCLUDER_DISTANCE = 40.0f;
+    const auto occluderMeshes = [&](const Model &model) {
+        std::vector<unsigned> meshes;
+        for (const Mesh &mesh : model.meshes) {
+            if (!mesh.alphaTested) {
+                meshes.push_back(
+                    occlusionRasterizer.addMesh(mesh.vertices, mesh.indices));
+            }
+        }
+        return meshes;
+    };
+    const std::vector<unsigned> terrainOccluders = occluderMeshes(terrain);
+    const std::vector<unsigned> barnOccluders = occluderMeshes(barn);
+    const std::vector<unsigned> pineOccluders = occluderMeshes(pine);
+    const auto addOccluders = [&](const std::vector<unsigned> &meshes,
+                                  const glm::mat4 &transform) {
+        for (const unsigned mesh : meshes)
+            occlusionRasterizer.addOccluder(mesh, transform);
+    };
+
+    std::unique_ptr<Shader> cullInstancesShader;
+    std::unique_ptr<GpuCulling> pineCulling;
+    if (gl43::supported()) {
+        cullInstancesShader = std::make_unique<Shader>(
+            "resources/shaders/cull_instances.comp");
+        pineCulling =
+            std::make_unique<GpuCulling>(*cullInstancesShader, pine.bounds());
+        pineCulling->setInstances(pineModels);
+    }
 
     std::vector<glm::vec3> lightColors {
         { 0.62, 0.35, 0.47 }, { 0.44, 0.69, 0.16 }, { 0.73, 0.43, 0.13 },
@@ -325,21 +526,85 @@ int main() {
         { 0.21, 0.16, 0.77 }, { 0.76, 0.36, 0.16 }
     };
 
-    std::vector<MagicLight> magicLights;
+    LightManager magicLights;
+    magicLights.bindUniformBlock(lightingPassShader);
+    magicLights.bindUniformBlock(lightVolumeStencilShader);
+    magicLights.bindUniformBlock(lightVolumeShader);
     for (auto i = 0u; i < lightColors.size(); i++) {
         glm::vec3 position { pinePositions[i].x, 4.0f, pinePositions[i].z };
-        magicLights.emplace_back(
-            position, 0.3f * lightColors[i], 2 * i, lightingPassShader);
+        magicLights.add(position, 0.3f * lightColors[i]);
 
         position.y = 10.0f;
-        magicLights.emplace_back(
-            position, 0.3f * lightColors[lightColors.size() - i - 1], 2 * i + 1,
-            lightingPassShader);
+        magicLights.add(
+            position, 0.3f * lightColors[lightColors.size() - i - 1]);
     }
+    // extra lights scattered over the terrain, lit by the clustered path only
+    const auto addMagicLight = [&]() {
+        const auto randomFloat = [](const float min, const float max) {
+            return min + (max - min) * static_cast<float>(std::rand()) /
+                             static_cast<float>(RAND_MAX);
+        };
+        const glm::vec3 position { randomFloat(-40.0f, 40.0f),
+                                   randomFloat(2.0f, 10.0f),
+                                   randomFloat(-70.0f, 70.0f) };
+        const glm::vec3 &color = lightColors[std::rand() % lightColors.size()];
+        magicLights.add(position, 0.3f * color);
+    };
 
     blurShader.uniform("image", 0);
+    bloomDownsampleShader.uniform("source", 0);
+    bloomUpsampleShader.uniform("source", 0);
+    luminanceShader.uniform("scene", 0);
+    adaptExposureShader.uniform("logLuminance", 0);
+    adaptExposureShader.uniform("previousLuminance", 1);
     bloomShader.uniform("scene", 0);
     bloomShader.uniform("bloomBlur", 1);
+    bloomShader.uniform("adaptedLuminance", 2);
+    programState->hdr.setShaders(
+        blurShader, bloomDownsampleShader, bloomUpsampleShader,
+        luminanceShader, adaptExposureShader, bloomShader);
+
+    lightingPassShader.uniform("shininess", 16.0f);
+    lightVolumeShader.uniform("shininess", 16.0f);
+    if (clusteredLightingPassShader)
+        clusteredLightingPassShader->uniform("shininess", 16.0f);
+
+    lightSourceShader.uniform("intensity", 5.0f);
+
+    glm::mat4 barnModel =
+        glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 1.9f, -40.0f));
+    barnModel = glm::rotate(barnModel, glm::radians(90.0f), glm::vec3(0, 1, 0));
+
+    glm::mat4 moonModel =
+        glm::translate(glm::mat4(1.0f), glm::vec3(-30.0f, 100.0f, 90.0f));
+    moonModel = glm::scale(moonModel, glm::vec3(4.0f));
+
+    glm::mat4 lanternModel =
+        glm::translate(glm::mat4(1.0f), glm::vec3(4.0f, 6.65f, -33.0f));
+    lanternModel = glm::scale(lanternModel, glm::vec3(0.3f));
+
+    RenderQueue &renderQueue = programState->renderQueue;
+
+    // queues the scene's meshes of one bucket for the depth pre-pass or the
+    // geometry pass, `instanced` draws the pines. Multi-draw reads every
+    // model matrix as an instance attribute, so it draws everything with
+    // `instanced`.
+    const auto submitScene = [&](const RenderPass pass, Shader &single,
+                                 Shader &instanced, const DrawBucket bucket) {
+        Frustum &frustum = programState->frustum;
+        Shader &shader = renderQueue.multiDraw() ? instanced : single;
+        terrain.Submit(
+            renderQueue, pass, shader, frustum, glm::mat4(1.0f), bucket);
+        if (programState->gpuCulling && pineCulling) {
+            pine.SubmitInstanced(
+                renderQueue, pass, instanced, *pineCulling, bucket);
+        } else {
+            pine.SubmitInstanced(
+                renderQueue, pass, instanced, pineInstances, bucket);
+        }
+        barn.Submit(renderQueue, pass, shader, frustum, barnModel, bucket);
+        vampire->submit(renderQueue, pass, shader, frustum, bucket);
+    };
 
     // draw in wireframe
     // glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
@@ -380,92 +645,177 @@ int main() {
                 static_cast<float>(screen.height),
             0.1f, 200.0f);
         glm::mat4 view = programState->camera.GetViewMatrix();
-
-        auto &geometryPassShader =
-            programState->deferredShading->geometryPassShader();
-        geometryPassShader.uniform("projection", projection);
-        geometryPassShader.uniform("view", view);
-
-        glm::mat4 model = glm::mat4(1.0f);
-        geometryPassShader.uniform("material.shininess", 2.0f);
-        geometryPassShader.uniform("model", model);
-        terrain.Draw(geometryPassShader);
-
-        for (const auto &modelMatrix : pineModels) {
-            geometryPassShader.uniform("model", modelMatrix);
-            pine.Draw(geometryPassShader);
+        Frustum &frustum = programState->frustum;
+        frustum.update(projection * view);
+        const DepthPyramid *occluders =
+            programState->deferredShading->depthPyramid();
+        frustum.setOcclusion(occluders ? &occluders->occlusion() : nullptr);
+        if (programState->softwareOcclusion) {
+            occlusionRasterizer.begin(projection * view);
+            addOccluders(terrainOccluders, glm::mat4(1.0f));
+            addOccluders(barnOccluders, barnModel);
+            pineGrid.visitNear(
+                programState->camera.Position, OCCLUDER_DISTANCE,
+                [&](const unsigned instance) {
+                    if (frustum.intersects(pineGrid.box(instance)))
+                        addOccluders(pineOccluders, pineModels[instance]);
+                });
+            occlusionRasterizer.rasterize();
+            frustum.setOcclusion(&occlusionRasterizer.occlusion());
         }
 
-        model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 1.9f, -40.0f));
-        model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0, 1, 0));
-        geometryPassShader.uniform("model", model);
-        barn.Draw(geometryPassShader);
-
-        vampire->draw(geometryPassShader, currentFrame, deltaTime);
+        frameConstants.setCamera(
+            view, projection, programState->camera.Position,
+            programState->camera.Front);
+        frameData.time = glm::vec4(currentFrame, deltaTime, 0.0f, 0.0f);
+        frameData.dirLightDirection = glm::vec4(dirLight.direction, 0.0f);
+        frameData.dirLightAmbient = glm::vec4(dirLight.ambient, 0.0f);
+        frameData.dirLightDiffuse = glm::vec4(dirLight.diffuse, 0.0f);
+        frameData.dirLightSpecular = glm::vec4(dirLight.specular, 0.0f);
+        frameData.pointLightPosition = glm::vec4(pointLight.position, 50.0f);
+        frameData.pointLightAmbient = glm::vec4(pointLight.ambient, 0.0f);
+        frameData.pointLightDiffuse = glm::vec4(pointLight.diffuse, 0.0f);
+        frameData.pointLightSpecular = glm::vec4(pointLight.specular, 0.0f);
+        frameData.pointLightAttenuation = glm::vec4(
+            pointLight.constant, pointLight.linear, pointLight.quadratic,
+            0.0f);
+        frameConstants.upload();
+
+        if (forestPines !=
+            static_cast<std::size_t>(programState->forestPines)) {
+            forestPines = programState->forestPines;
+            growForest(forestPines);
+            pineInstancesStale = true;
+            if (pineCulling) pineCulling->setInstances(pineModels);
+        }
+        if (programState->gpuCulling && pineCulling) {
+            pineCulling->cull(frustum.enabled(), occluders);
+        } else {
+            // whole chunks first, then the pines of the chunks that pass
+            visiblePines.clear();
+            for (const InstanceGrid::Cell &chunk : pineGrid.cells()) {
+                if (chunk.instances.empty() ||
+                    frustum.cull(
+                        chunk.bounds,
+                        pine.triangles() * chunk.instances.size()))
+                    continue;
+                for (const unsigned instance : chunk.instances) {
+                    if (!frustum.cull(pineGrid.box(instance), pine.triangles()))
+                        visiblePines.push_back(instance);
+                }
+            }
+            if (pineInstancesStale || visiblePines != uploadedPines) {
+                uploadedPines.swap(visiblePines);
+                pineInstancesStale = false;
+                visiblePineModels.clear();
+                for (const unsigned instance : uploadedPines)
+                    visiblePineModels.push_back(pineModels[instance]);
+                pineInstances.update(visiblePineModels);
+            }
+        }
+        vampire->update(currentFrame, deltaTime);
+
+        DeferredShading &deferredShading = *programState->deferredShading;
+        const bool depthPrePass = deferredShading.depthPrePass();
+        renderQueue.begin(programState->camera.Position, 200.0f);
+        if (depthPrePass) {
+            // opaque meshes have no texture coordinates in their
+            // position-only stream, so the buckets are always split here
+            submitScene(
+                RenderPass::DepthOpaque, depthPrePassShader[0],
+                depthPrePassShader[INSTANCED], DrawBucket::Opaque);
+            submitScene(
+                RenderPass::DepthAlphaTested, depthPrePassShader[ALPHA_TEST],
+                depthPrePassShader[ALPHA_TEST | INSTANCED],
+                DrawBucket::AlphaTested);
+        }
+        // opaque meshes first, with a shader that never discards so they
+        // keep early depth testing, then the cut-outs (the pine leaves)
+        // with the discarding variant against the opaque depth. After the
+        // pre-pass the depth test alone rejects the cut-out texels.
+        const unsigned alphaTest = depthPrePass ? 0 : ALPHA_TEST;
+        if (programState->alphaTestSplit) {
+            submitScene(
+                RenderPass::GeometryOpaque, geometryPassShader[0],
+                geometryPassInstancedShader[0], DrawBucket::Opaque);
+            submitScene(
+                RenderPass::GeometryAlphaTested, geometryPassShader[alphaTest],
+                geometryPassInstancedShader[alphaTest],
+                DrawBucket::AlphaTested);
+        } else {
+            submitScene(
+                RenderPass::GeometryOpaque, geometryPassShader[alphaTest],
+                geometryPassInstancedShader[alphaTest], DrawBucket::All);
+        }
+        const unsigned lightSourceInstanced =
+            renderQueue.multiDraw() ? INSTANCED : 0;
+        moon.Submit(
+            renderQueue, RenderPass::LightSources,
+            lightSourceShader[ALL_BRIGHT | lightSourceInstanced], frustum,
+            moonModel);
+        lantern.Submit(
+            renderQueue, RenderPass::LightSources,
+            lightSourceShader[lightSourceInstanced], frustum, lanternModel);
+        renderQueue.sort();
+
+        if (depthPrePass) {
+            deferredShading.beginDepthPrePass();
+            renderQueue.execute(RenderPass::DepthOpaque);
+            renderQueue.execute(RenderPass::DepthAlphaTested);
+        }
+        deferredShading.beginGeometryPass();
+        programState->opaqueSamples.begin();
+        renderQueue.execute(RenderPass::GeometryOpaque);
+        programState->opaqueSamples.end();
+        programState->alphaTestedSamples.begin();
+        renderQueue.execute(RenderPass::GeometryAlphaTested);
+        programState->alphaTestedSamples.end();
+        deferredShading.endGeometryPass();
+        deferredShading.buildDepthPyramid(projection * view);
 
         programState->deferredShading->unbind();
 
         programState->hdr.bind();
         // 2. lighting pass: calculate lighting by iterating over a screen
         // filled quad pixel-by-pixel using the gbuffer's content.
+        programState->deferredShading->setFlashlight(programState->flashlight);
         programState->deferredShading->bindTextures();
-        // send light relevant uniforms
-        lightingPassShader.uniform("pointLight.position", pointLight.position);
-        lightingPassShader.uniform("pointLight.ambient", pointLight.ambient);
-        lightingPassShader.uniform("pointLight.diffuse", pointLight.diffuse);
-        lightingPassShader.uniform("pointLight.specular", pointLight.specular);
-        lightingPassShader.uniform("pointLight.constant", pointLight.constant);
-        lightingPassShader.uniform("pointLight.linear", pointLight.linear);
-        lightingPassShader.uniform(
-            "pointLight.quadratic", pointLight.quadratic);
-        lightingPassShader.uniform("pointLight.radius", 50.0f);
-        lightingPassShader.uniform("dirLight.direction", dirLight.direction);
-        lightingPassShader.uniform("dirLight.ambient", dirLight.ambient);
-        lightingPassShader.uniform("dirLight.diffuse", dirLight.diffuse);
-        lightingPassShader.uniform("dirLight.specular", dirLight.specular);
-        lightingPassShader.uniform(
-            "spotLight.position", programState->camera.Position);
-        lightingPassShader.uniform(
-            "spotLight.direction", programState->camera.Front);
-        lightingPassShader.uniform("flashlight", programState->flashlight);
-        lightingPassShader.uniform(
-            "viewPosition", programState->camera.Position);
-        lightingPassShader.uniform("shininess", 16.0f);
-
-        for (auto &light : magicLights) {
-            light.nextFrame(currentFrame);
+
+        // the slider takes typed-in values past its range
+        programState->magicLightCount = std::min(
+            std::max(
+                programState->magicLightCount,
+                static_cast<int>(LightManager::UNIFORM_LIGHTS)),
+            MAX_MAGIC_LIGHTS);
+        const auto magicLightCount =
+            static_cast<std::size_t>(programState->magicLightCount);
+        while (magicLights.size() > magicLightCount) {
+            magicLights.pop();
+        }
+        while (magicLights.size() < magicLightCount) {
+            addMagicLight();
         }
+        magicLights.setGpuMotion(programState->gpuLightMotion);
+        magicLights.nextFrame(currentFrame);
+        programState->deferredShading->updateLights(
+            magicLights, view, projection);
         // finally render quad
         programState->deferredShading->render(programState->hdr.buffer());
 
         // 3. render lights on top of scene
-        lightSourceShader.use();
-        lightSourceShader.uniform("projection", projection);
-        lightSourceShader.uniform("view", view);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-30.0f, 100.0f, 90.0f));
-        model = glm::scale(model, glm::vec3(4.0f));
-        lightSourceShader.uniform("model", model);
-        lightSourceShader.uniform("allBright", true);
-        lightSourceShader.uniform("intensity", 5.0f);
-        moon.Draw(lightSourceShader);
-
-        model = glm::translate(glm::mat4(1.0f), glm::vec3(4.0f, 6.65f, -33.0f));
-        model = glm::scale(model, glm::vec3(0.3f));
-        lightSourceShader.uniform("model", model);
-        lightSourceShader.uniform("allBright", false);
-        lightSourceShader.uniform("intensity", 5.0f);
-        lantern.Draw(lightSourceShader);
-
-        skybox.draw(view, projection);
+        renderQueue.execute(RenderPass::LightSources);
+
+        skybox.draw();
 
         programState->hdr.unbind();
 
-        programState->hdr.blur(blurShader);
-        programState->hdr.bloom(bloomShader);
+        programState->hdr.adaptExposure(deltaTime);
+        programState->hdr.blur();
+        programState->hdr.bloom();
 
         if (programState->ImGuiEnabled) DrawImGui(programState);
+        GLState::get().endFrame();
+        frustum.endFrame();
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse
         // moved etc.)
@@ -514,6 +864,8 @@ void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
     screen.height = height;
     programState->deferredShading->resize(width, height);
     programState->hdr.resize(width, height);
+    programState->occlusionRasterizer.resize(
+        width / OCCLUSION_DOWNSCALE, height / OCCLUSION_DOWNSCALE);
     glViewport(0, 0, width, height);
 }
 
@@ -570,6 +922,14 @@ void DrawImGui(ProgramState *programState) {
         static float hdrExposure { programState->hdr.exposure() };
         ImGui::DragFloat("hdr.exposure", &hdrExposure, 0.05, 0.0, 5.0);
         programState->hdr.setExposure(hdrExposure);
+        bool autoExposure = programState->hdr.autoExposure();
+        if (ImGui::Checkbox("Auto exposure (E)", &autoExposure)) {
+            programState->hdr.setAutoExposure(autoExposure);
+        }
+        if (autoExposure) {
+            ImGui::Text(
+                "Adapted exposure: %.3f", programState->hdr.measuredExposure());
+        }
 
         ImGui::End();
     }
@@ -589,6 +949,140 @@ void DrawImGui(ProgramState *programState) {
         ImGui::End();
     }
 
+    {
+        ImGui::Begin("Rendering");
+        const float framerate = ImGui::GetIO().Framerate;
+        ImGui::Text(
+            "Frame time: %.3f ms (%.1f FPS)", 1000.0f / framerate, framerate);
+        bool tiledLighting = programState->deferredShading->tiledLighting();
+        if (ImGui::Checkbox("Tiled lighting (T)", &tiledLighting)) {
+            programState->deferredShading->setTiledLighting(tiledLighting);
+        }
+        bool lightVolumeLighting =
+            programState->deferredShading->lightVolumeLighting();
+        if (ImGui::Checkbox("Light volumes (U)", &lightVolumeLighting)) {
+            programState->deferredShading->setLightVolumeLighting(
+                lightVolumeLighting);
+        }
+        Frustum &frustum = programState->frustum;
+        bool frustumCulling = frustum.enabled();
+        if (ImGui::Checkbox("Frustum culling (V)", &frustumCulling)) {
+            frustum.setEnabled(frustumCulling);
+        }
+        ImGui::Text(
+            "Draws visible: %lu culled: %lu", frustum.frameStats().visible,
+            frustum.frameStats().culled);
+        bool occlusionCulling =
+            programState->deferredShading->occlusionCulling();
+        if (ImGui::Checkbox("Occlusion culling (Z)", &occlusionCulling)) {
+            programState->deferredShading->setOcclusionCulling(
+                occlusionCulling);
+        }
+        // GPU-culled pines are not counted
+        ImGui::Text(
+            "Occluded draws: %lu, triangles saved: %lu",
+            frustum.frameStats().occluded,
+            frustum.frameStats().occludedTriangles);
+        ImGui::Checkbox(
+            "Software occlusion culling (X)", &programState->softwareOcclusion);
+        const RenderQueue::Stats &queueStats =
+            programState->renderQueue.stats();
+        ImGui::Text(
+            "Queued draws: %u in %u calls, changes: %u program %u material "
+            "%u model",
+            queueStats.draws, queueStats.calls, queueStats.programChanges,
+            queueStats.materialChanges, queueStats.modelChanges);
+        if (gl43::supported()) {
+            bool multiDraw = programState->renderQueue.multiDraw();
+            if (ImGui::Checkbox("Multi-draw indirect (I)", &multiDraw)) {
+                programState->renderQueue.setMultiDraw(multiDraw);
+            }
+            // GPU-culled pines are not counted by the frustum statistics
+            ImGui::Checkbox("GPU pine culling (K)", &programState->gpuCulling);
+        }
+        ImGui::SliderInt(
+            "Forest pines", &programState->forestPines, 0, MAX_FOREST_PINES);
+        // last measured frame of each path
+        ImGui::Text(
+            "Queue CPU time: %.3f ms direct, %.3f ms multi-draw",
+            programState->renderQueue.cpuMilliseconds(false),
+            programState->renderQueue.cpuMilliseconds(true));
+        bool mipChainBloom =
+            programState->hdr.bloomMode() == HDR::BloomMode::MipChain;
+        if (ImGui::Checkbox("Mip-chain bloom (M)", &mipChainBloom)) {
+            programState->hdr.setBloomMode(
+                mipChainBloom ? HDR::BloomMode::MipChain
+                              : HDR::BloomMode::Gaussian);
+        }
+        bool compactGBuffer = programState->deferredShading->compactGBuffer();
+        if (ImGui::Checkbox("Compact G-buffer (G)", &compactGBuffer)) {
+            programState->deferredShading->setCompactGBuffer(compactGBuffer);
+        }
+        ImGui::Text(
+            "G-buffer: %u bytes/pixel",
+            programState->deferredShading->gBufferBytesPerPixel());
+        if (gl43::supported()) {
+            bool clusteredLighting =
+                programState->deferredShading->clusteredLighting();
+            if (ImGui::Checkbox("Clustered lighting (C)", &clusteredLighting)) {
+                programState->deferredShading->setClusteredLighting(
+                    clusteredLighting);
+            }
+            ImGui::SliderInt(
+                "Magic lights", &programState->magicLightCount,
+                LightManager::UNIFORM_LIGHTS, MAX_MAGIC_LIGHTS);
+            const ClusteredShading *clustered =
+                programState->deferredShading->clusteredShading();
+            if (clusteredLighting && clustered) {
+                ImGui::Text(
+                    "Cluster light indices: %u of %u, dropped %u",
+                    clustered->requiredIndices(), clustered->capacity(),
+                    clustered->droppedIndices());
+            }
+        } else {
+            ImGui::Text("Clustered lighting needs OpenGL 4.3");
+        }
+        ImGui::Checkbox("GPU light motion (L)", &programState->gpuLightMotion);
+        ImGui::Checkbox(
+            "Opaque/alpha-tested split (O)", &programState->alphaTestSplit);
+        // samples per pixel that passed the depth test in each pass; without
+        // the split everything is counted as opaque
+        const double pixels = static_cast<double>(screen.width) * screen.height;
+        ImGui::Text(
+            "G-buffer samples/pixel: %.2f opaque, %.2f alpha-tested",
+            programState->opaqueSamples.result() / pixels,
+            programState->alphaTestedSamples.result() / pixels);
+        DeferredShading &deferredShading = *programState->deferredShading;
+        bool depthPrePass = deferredShading.depthPrePass();
+        if (ImGui::Checkbox("Depth pre-pass (P)", &depthPrePass)) {
+            deferredShading.setDepthPrePass(depthPrePass);
+        }
+        // last measured frames of each configuration, to pick per scene
+        ImGui::Text(
+            "Geometry pass: %.3f ms, with pre-pass %.3f + %.3f ms",
+            deferredShading.geometryPassMilliseconds(false),
+            deferredShading.depthPrePassMilliseconds(),
+            deferredShading.geometryPassMilliseconds(true));
+        ImGui::End();
+    }
+
+    {
+        ImGui::Begin("GL state");
+        const GLState::Stats &stats = GLState::get().frameStats();
+        const auto counter = [](const char *name,
+                                const GLState::Counter &counter) {
+            ImGui::Text(
+                "%-16s issued: %5lu skipped: %5lu", name, counter.issued,
+                counter.skipped);
+        };
+        counter("program", stats.program);
+        counter("vertex array", stats.vertexArray);
+        counter("framebuffer", stats.framebuffer);
+        counter("active texture", stats.activeTexture);
+        counter("texture", stats.texture);
+        ImGui::End();
+    }
+
     ImGui::Render();
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 }
@@ -607,6 +1101,48 @@ void key_callback(
         programState->flashlight = !programState->flashlight;
     } else if (key == GLFW_KEY_B && action == GLFW_PRESS) {
         programState->hdr.setBloomState(!programState->hdr.bloomState());
+    } else if (key == GLFW_KEY_E && action == GLFW_PRESS) {
+        programState->hdr.setAutoExposure(!programState->hdr.autoExposure());
+    } else if (key == GLFW_KEY_V && action == GLFW_PRESS) {
+        programState->frustum.setEnabled(!programState->frustum.enabled());
+    } else if (key == GLFW_KEY_M && action == GLFW_PRESS) {
+        auto &hdr = programState->hdr;
+        hdr.setBloomMode(
+            hdr.bloomMode() == HDR::BloomMode::MipChain
+                ? HDR::BloomMode::Gaussian
+                : HDR::BloomMode::MipChain);
+    } else if (key == GLFW_KEY_T && action == GLFW_PRESS) {
+        auto &deferredShading = *programState->deferredShading;
+        deferredShading.setTiledLighting(!deferredShading.tiledLighting());
+    } else if (key == GLFW_KEY_U && action == GLFW_PRESS) {
+        auto &deferredShading = *programState->deferredShading;
+        deferredShading.setLightVolumeLighting(
+            !deferredShading.lightVolumeLighting());
+    } else if (key == GLFW_KEY_G && action == GLFW_PRESS) {
+        auto &deferredShading = *programState->deferredShading;
+        deferredShading.setCompactGBuffer(!deferredShading.compactGBuffer());
+    } else if (key == GLFW_KEY_C && action == GLFW_PRESS) {
+        auto &deferredShading = *programState->deferredShading;
+        deferredShading.setClusteredLighting(
+            !deferredShading.clusteredLighting());
+    } else if (key == GLFW_KEY_L && action == GLFW_PRESS) {
+        programState->gpuLightMotion = !programState->gpuLightMotion;
+    } else if (key == GLFW_KEY_O && action == GLFW_PRESS) {
+        programState->alphaTestSplit = !programState->alphaTestSplit;
+    } else if (key == GLFW_KEY_P && action == GLFW_PRESS) {
+        auto &deferredShading = *programState->deferredShading;
+        deferredShading.setDepthPrePass(!deferredShading.depthPrePass());
+    } else if (key == GLFW_KEY_Z && action == GLFW_PRESS) {
+        auto &deferredShading = *programState->deferredShading;
+        deferredShading.setOcclusionCulling(
+            !deferredShading.occlusionCulling());
+    } else if (key == GLFW_KEY_X && action == GLFW_PRESS) {
+        programState->softwareOcclusion = !programState->softwareOcclusion;
+    } else if (key == GLFW_KEY_K && action == GLFW_PRESS) {
+        programState->gpuCulling = !programState->gpuCulling;
+    } else if (key == GLFW_KEY_I && action == GLFW_PRESS) {
+        auto &renderQueue = programState->renderQueue;
+        renderQueue.setMultiDraw(!renderQueue.multiDraw());
     }
 }
 